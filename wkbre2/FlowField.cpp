@@ -0,0 +1,69 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#include "FlowField.h"
+#include "HierarchicalPathfinder.h"
+#include <algorithm>
+
+namespace {
+	// same moves and costs as the A* of Pathfinding.h, the opposite of neighbour i is i ^ 1
+	const int NEIGHBOURS[8][3] = { {1, 0, 100}, {-1, 0, 100}, {0, 1, 100}, {0, -1, 100},
+		{1, 1, 141}, {-1, -1, 141}, {1, -1, 141}, {-1, 1, 141} };
+}
+
+FlowField::FlowField(const HierarchicalPathfinder* passability, PFPos destination)
+	: passability(passability), destination(destination), width(passability->getNumTilesX()), height(passability->getNumTilesZ())
+{
+	const size_t numTiles = (size_t)width * height;
+	costs.assign(numTiles, UNREACHED);
+	directions.assign(numTiles, NO_DIRECTION);
+	settled.assign(numTiles, false);
+	if (!passability->isBlocked(destination.x, destination.z)) {
+		const int index = destination.z * width + destination.x;
+		costs[index] = 0;
+		open.emplace(0, index);
+	}
+}
+
+bool FlowField::expandUntil(int index)
+{
+	while (!settled[index] && !open.empty()) {
+		const auto [cost, current] = open.top();
+		open.pop();
+		if (settled[current])
+			continue;
+		settled[current] = true;
+		numSettled++;
+		const int x = current % width, z = current / width;
+		for (int i = 0; i < 8; i++) {
+			const auto& [dx, dz, stepCost] = NEIGHBOURS[i];
+			const int nx = x + dx, nz = z + dz;
+			if (passability->isBlocked(nx, nz)) // also true outside of the map
+				continue;
+			const int nindex = nz * width + nx;
+			const int ncost = cost + stepCost;
+			if (costs[nindex] == UNREACHED || ncost < costs[nindex]) {
+				costs[nindex] = ncost;
+				directions[nindex] = (uint8_t)(i ^ 1); // back to the current tile
+				open.emplace(ncost, nindex);
+			}
+		}
+	}
+	return settled[index];
+}
+
+std::vector<Pathfinding::PFPos> FlowField::getPath(PFPos start)
+{
+	if (passability->isBlocked(start.x, start.z) || !expandUntil(start.z * width + start.x))
+		return {};
+	std::vector<PFPos> path = { start };
+	PFPos pos = start;
+	while (pos != destination) {
+		const uint8_t dir = directions[pos.z * width + pos.x];
+		pos = { pos.x + NEIGHBOURS[dir][0], pos.z + NEIGHBOURS[dir][1] };
+		path.push_back(pos);
+	}
+	std::reverse(path.begin(), path.end());
+	return path;
+}
@@ -0,0 +1,53 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#pragma once
+
+#include "Pathfinding.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+class HierarchicalPathfinder;
+
+// Path to a destination tile from any tile, shared by all the units going to the same place.
+// The integration field (cost from every tile to the destination) is computed with Dijkstra from the destination,
+// and every reached tile points to its neighbour on the way to the destination (flow field).
+// The search only goes as far as needed by the units asking for a path, and is resumed for the units farther away,
+// so that the same field is always obtained whatever the order of the requests.
+// The passability is the one of the pathfinder at its last update, which must not change while the field is used.
+class FlowField
+{
+public:
+	using PFPos = Pathfinding::PFPos;
+
+	FlowField(const HierarchicalPathfinder* passability, PFPos destination);
+
+	// Returns the tiles of the path from the destination to start (like Pathfinding::DoPathfinding),
+	// or an empty vector if the destination can't be reached
+	std::vector<PFPos> getPath(PFPos start);
+
+	PFPos getDestination() const { return destination; }
+	size_t getNumSettledTiles() const { return numSettled; }
+
+private:
+	static constexpr int UNREACHED = -1;
+	static constexpr uint8_t NO_DIRECTION = 0xFF;
+
+	const HierarchicalPathfinder* passability;
+	PFPos destination;
+	int width, height;
+	std::vector<int> costs;          // integration field, UNREACHED if not reached yet
+	std::vector<uint8_t> directions; // flow field, index in NEIGHBOURS of the next tile to the destination
+	std::vector<bool> settled;       // the cost and direction of the tile are final
+	size_t numSettled = 0;
+	using QueueEntry = std::pair<int, int>; // cost, tile index
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> open;
+
+	// Continues the search until the tile is settled, returns false if it can't be reached
+	bool expandUntil(int index);
+};
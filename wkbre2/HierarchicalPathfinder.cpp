@@ -0,0 +1,263 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#include "HierarchicalPathfinder.h"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <utility>
+
+void HierarchicalPathfinder::update(const CommonGameState* gameState, CommonGameState::MovementClass movementClass)
+{
+	const int ncx = (gameState->numTilesX + CLUSTER_SIZE - 1) >> CLUSTER_SHIFT;
+	const int ncz = (gameState->numTilesZ + CLUSTER_SIZE - 1) >> CLUSTER_SHIFT;
+	if (gameState != this->gameState || movementClass != this->movementClass
+		|| gameState->numTilesX != numTilesX || gameState->numTilesZ != numTilesZ) {
+		this->gameState = gameState;
+		this->movementClass = movementClass;
+		numTilesX = gameState->numTilesX;
+		numTilesZ = gameState->numTilesZ;
+		numClustersX = ncx;
+		numClustersZ = ncz;
+		clusters.assign((size_t)ncx * ncz, Cluster());
+		upToDate = false;
+	}
+	if (upToDate && updatedAt == gameState->passabilityChangeCounter)
+		return;
+	blocked = gameState->tileBlocked[movementClass];
+	for (int cz = 0; cz < numClustersZ; cz++)
+		for (int cx = 0; cx < numClustersX; cx++)
+			if (needsRebuild(cx, cz))
+				buildCluster(cx, cz);
+	updatedAt = gameState->passabilityChangeCounter;
+	upToDate = true;
+}
+
+bool HierarchicalPathfinder::needsRebuild(int cx, int cz) const
+{
+	const Cluster& cluster = clusters[cz * numClustersX + cx];
+	if (!cluster.built)
+		return true;
+	// the entrances on the borders also depend on the tiles of the neighbours
+	static const int offsets[5][2] = { {0, 0}, {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+	for (const auto& [dx, dz] : offsets) {
+		const int nx = cx + dx, nz = cz + dz;
+		if (nx < 0 || nx >= numClustersX || nz < 0 || nz >= numClustersZ)
+			continue;
+		if (gameState->tileBlocks[1][nz * gameState->tileBlocksPerRow[1] + nx].lastPassabilityChange > cluster.builtAt)
+			return true;
+	}
+	return false;
+}
+
+template <typename Func> void HierarchicalPathfinder::forEachBorderEntrance(int cx, int cz, bool vertical, Func func) const
+{
+	// the border is between the line "last" of the cluster and the line "last + 1" of the neighbour
+	const int last = (vertical ? (cz + 1) : (cx + 1)) * CLUSTER_SIZE - 1;
+	const int first = (vertical ? cx : cz) * CLUSTER_SIZE;
+	const int end = std::min(first + CLUSTER_SIZE, vertical ? numTilesX : numTilesZ);
+	if (last + 1 >= (vertical ? numTilesZ : numTilesX))
+		return;
+	auto tileA = [&](int i) { return vertical ? PFPos{ i, last } : PFPos{ last, i }; };
+	auto tileB = [&](int i) { return vertical ? PFPos{ i, last + 1 } : PFPos{ last + 1, i }; };
+	int runStart = -1;
+	for (int i = first; i <= end; i++) {
+		const bool free = i < end && !isBlocked(tileA(i).x, tileA(i).z) && !isBlocked(tileB(i).x, tileB(i).z);
+		if (free && runStart == -1)
+			runStart = i;
+		else if (!free && runStart != -1) {
+			const int middle = (runStart + i - 1) / 2;
+			func(tileA(middle), tileB(middle));
+			runStart = -1;
+		}
+	}
+}
+
+void HierarchicalPathfinder::computeCostsInCluster(const Cluster& cluster, PFPos from, std::vector<int>& costs) const
+{
+	const int width = cluster.x1 - cluster.x0, height = cluster.z1 - cluster.z0;
+	costs.assign((size_t)width * height, UNREACHABLE);
+	using QueueEntry = std::pair<int, int>; // cost, tile index in the cluster
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+	const int fromIndex = (from.z - cluster.z0) * width + (from.x - cluster.x0);
+	costs[fromIndex] = 0;
+	queue.emplace(0, fromIndex);
+	static const int neighbours[8][3] = { {1, 0, 100}, {-1, 0, 100}, {0, 1, 100}, {0, -1, 100},
+		{1, 1, 141}, {-1, 1, 141}, {1, -1, 141}, {-1, -1, 141} };
+	while (!queue.empty()) {
+		const auto [cost, index] = queue.top();
+		queue.pop();
+		if (cost > costs[index])
+			continue;
+		const int x = index % width, z = index / width;
+		for (const auto& [dx, dz, stepCost] : neighbours) {
+			const int nx = x + dx, nz = z + dz;
+			if (nx < 0 || nx >= width || nz < 0 || nz >= height)
+				continue;
+			if (isBlocked(cluster.x0 + nx, cluster.z0 + nz))
+				continue;
+			const int nindex = nz * width + nx;
+			const int ncost = cost + stepCost;
+			if (costs[nindex] == UNREACHABLE || ncost < costs[nindex]) {
+				costs[nindex] = ncost;
+				queue.emplace(ncost, nindex);
+			}
+		}
+	}
+}
+
+void HierarchicalPathfinder::buildCluster(int cx, int cz)
+{
+	Cluster& cluster = clusters[cz * numClustersX + cx];
+	cluster.x0 = cx * CLUSTER_SIZE;
+	cluster.z0 = cz * CLUSTER_SIZE;
+	cluster.x1 = std::min(cluster.x0 + CLUSTER_SIZE, numTilesX);
+	cluster.z1 = std::min(cluster.z0 + CLUSTER_SIZE, numTilesZ);
+	cluster.entrances.clear();
+	// the borders are computed the same way from both sides, so the entrances of the neighbours match
+	auto addEntrance = [&cluster](PFPos pos, PFPos partner) { cluster.entrances.push_back({ pos, partner }); };
+	if (cx > 0)
+		forEachBorderEntrance(cx - 1, cz, false, [&](PFPos a, PFPos b) { addEntrance(b, a); });
+	if (cz > 0)
+		forEachBorderEntrance(cx, cz - 1, true, [&](PFPos a, PFPos b) { addEntrance(b, a); });
+	forEachBorderEntrance(cx, cz, false, addEntrance);
+	forEachBorderEntrance(cx, cz, true, addEntrance);
+
+	const size_t numEntrances = cluster.entrances.size();
+	cluster.distances.assign(numEntrances * numEntrances, UNREACHABLE);
+	std::vector<int> costs;
+	const int width = cluster.x1 - cluster.x0;
+	for (size_t i = 0; i < numEntrances; i++) {
+		computeCostsInCluster(cluster, cluster.entrances[i].pos, costs);
+		for (size_t j = 0; j < numEntrances; j++) {
+			const PFPos& pos = cluster.entrances[j].pos;
+			cluster.distances[i * numEntrances + j] = costs[(pos.z - cluster.z0) * width + (pos.x - cluster.x0)];
+		}
+	}
+	cluster.builtAt = gameState->passabilityChangeCounter;
+	cluster.built = true;
+}
+
+int HierarchicalPathfinder::findPartner(const Entrance& entrance) const
+{
+	const Cluster& neighbour = clusters[getClusterIndex(entrance.partner)];
+	for (size_t i = 0; i < neighbour.entrances.size(); i++)
+		if (neighbour.entrances[i].pos == entrance.partner && neighbour.entrances[i].partner == entrance.pos)
+			return (int)i;
+	return -1;
+}
+
+std::vector<Pathfinding::PFPos> HierarchicalPathfinder::findPath(PFPos start, PFPos end) const
+{
+	using namespace Pathfinding;
+	auto pred = [this](PFPos pos) { return isBlocked(pos.x, pos.z); };
+	auto inMap = [&](PFPos pos) { return pos.x >= 0 && pos.x < numTilesX && pos.z >= 0 && pos.z < numTilesZ; };
+	if (!inMap(start) || !inMap(end) || clusters.empty()
+		|| (std::abs(end.x - start.x) < MIN_HIERARCHICAL_DISTANCE && std::abs(end.z - start.z) < MIN_HIERARCHICAL_DISTANCE))
+		return DoPathfinding(start, end, numTilesX, numTilesZ, pred, ManhattanDiagHeuristic);
+
+	// Abstract graph: the entrances, plus the start and the end connected to the entrances of their clusters
+	const int startCluster = getClusterIndex(start), endCluster = getClusterIndex(end);
+	std::vector<int> startCosts, endCosts;
+	computeCostsInCluster(clusters[startCluster], start, startCosts);
+	computeCostsInCluster(clusters[endCluster], end, endCosts);
+	auto costInCluster = [this](const std::vector<int>& costs, int clusterIndex, PFPos pos) {
+		const Cluster& cluster = clusters[clusterIndex];
+		return costs[(pos.z - cluster.z0) * (cluster.x1 - cluster.x0) + (pos.x - cluster.x0)];
+	};
+
+	// A* on the abstract graph, the nodes are numbered by cluster and entrance
+	std::vector<int> firstNode(clusters.size() + 1, 0);
+	for (size_t c = 0; c < clusters.size(); c++)
+		firstNode[c + 1] = firstNode[c] + (int)clusters[c].entrances.size();
+	const int endNode = firstNode.back(), numNodes = endNode + 1;
+	std::vector<int> scores(numNodes, UNREACHABLE), parents(numNodes, -1);
+	std::vector<bool> closed(numNodes, false);
+	auto nodePos = [&](int node) {
+		if (node == endNode)
+			return end;
+		const int c = (int)(std::upper_bound(firstNode.begin(), firstNode.end(), node) - firstNode.begin()) - 1;
+		return clusters[c].entrances[node - firstNode[c]].pos;
+	};
+	using QueueEntry = std::pair<int, int>; // score + heuristic, node
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+	auto reach = [&](int node, int parent, int score) {
+		if (closed[node] || (scores[node] != UNREACHABLE && scores[node] <= score))
+			return;
+		scores[node] = score;
+		parents[node] = parent;
+		queue.emplace(score + ManhattanDiagHeuristic(nodePos(node), end), node);
+	};
+	// from the start to the entrances of its cluster (parent -1 = start)
+	const Cluster& firstCluster = clusters[startCluster];
+	for (size_t i = 0; i < firstCluster.entrances.size(); i++) {
+		const int cost = costInCluster(startCosts, startCluster, firstCluster.entrances[i].pos);
+		if (cost != UNREACHABLE)
+			reach(firstNode[startCluster] + (int)i, -1, cost);
+	}
+	bool found = false;
+	while (!queue.empty()) {
+		const int node = queue.top().second;
+		queue.pop();
+		if (closed[node])
+			continue;
+		closed[node] = true;
+		if (node == endNode) {
+			found = true;
+			break;
+		}
+		const int c = (int)(std::upper_bound(firstNode.begin(), firstNode.end(), node) - firstNode.begin()) - 1;
+		const Cluster& cluster = clusters[c];
+		const int e = node - firstNode[c];
+		const int score = scores[node];
+		const size_t numEntrances = cluster.entrances.size();
+		// inside the cluster
+		for (size_t j = 0; j < numEntrances; j++) {
+			const int cost = cluster.distances[e * numEntrances + j];
+			if (cost != UNREACHABLE && (int)j != e)
+				reach(firstNode[c] + (int)j, node, score + cost);
+		}
+		if (c == endCluster) {
+			const int cost = costInCluster(endCosts, endCluster, cluster.entrances[e].pos);
+			if (cost != UNREACHABLE)
+				reach(endNode, node, score + cost);
+		}
+		// through the border
+		const Entrance& entrance = cluster.entrances[e];
+		const int partnerCluster = getClusterIndex(entrance.partner);
+		const int partner = findPartner(entrance);
+		if (partner != -1)
+			reach(firstNode[partnerCluster] + partner, node, score + 100);
+	}
+	// The entrances only join tiles facing each other, so a path that goes from a cluster to another
+	// only diagonally (through the corner) isn't in the abstract graph: let the plain A* decide.
+	if (!found)
+		return DoPathfinding(start, end, numTilesX, numTilesZ, pred, ManhattanDiagHeuristic);
+
+	// Refine: A* between the consecutive waypoints, which are close to each other
+	std::vector<PFPos> waypoints = { end };
+	for (int node = parents[endNode]; node != -1; node = parents[node])
+		waypoints.push_back(nodePos(node));
+	waypoints.push_back(start);
+	std::vector<PFPos> path = { end };
+	for (size_t i = 0; i + 1 < waypoints.size(); i++) {
+		if (waypoints[i] == waypoints[i + 1])
+			continue;
+		// from waypoints[i + 1] to waypoints[i], returned from waypoints[i] to waypoints[i + 1]
+		auto segment = DoPathfinding(waypoints[i + 1], waypoints[i], numTilesX, numTilesZ, pred, ManhattanDiagHeuristic);
+		if (segment.empty())
+			return DoPathfinding(start, end, numTilesX, numTilesZ, pred, ManhattanDiagHeuristic);
+		path.insert(path.end(), segment.begin() + 1, segment.end());
+	}
+	return path;
+}
+
+size_t HierarchicalPathfinder::getNumEntrances() const
+{
+	size_t count = 0;
+	for (const Cluster& cluster : clusters)
+		count += cluster.entrances.size();
+	return count;
+}
@@ -0,0 +1,83 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#pragma once
+
+#include "common.h"
+#include "Pathfinding.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical pathfinding (HPA*) for one movement class.
+// The map is divided in clusters (the level 1 tile blocks of CommonGameState), with an entrance in the middle
+// of every run of free tiles along the border of two neighbouring clusters. The distances between the entrances
+// of a cluster are precomputed, so a long path is first searched on the small graph of the entrances,
+// then refined with A* between the consecutive entrances. If no path is found on the graph of the entrances
+// (e.g. the only way crosses the corner of a cluster diagonally), the path is searched with A* on the whole map.
+// A cluster is rebuilt when the passability of its tiles or of the tiles of its neighbours changed.
+// The passability is copied by update(), so findPath() can run on worker threads while the game state changes,
+// as long as update() isn't called at the same time.
+class HierarchicalPathfinder
+{
+public:
+	using PFPos = Pathfinding::PFPos;
+	static constexpr int CLUSTER_SHIFT = CommonGameState::TILE_BLOCK_SHIFT[1];
+	static constexpr int CLUSTER_SIZE = 1 << CLUSTER_SHIFT;
+	// paths shorter than this (in tiles, on both axes) are directly searched with A*
+	static constexpr int MIN_HIERARCHICAL_DISTANCE = 2 * CLUSTER_SIZE;
+
+	// Rebuilds the clusters whose passability changed (all of them the first time)
+	void update(const CommonGameState* gameState, CommonGameState::MovementClass movementClass);
+	// Returns the tiles of a path from end to start (like Pathfinding::DoPathfinding), or an empty vector if none found.
+	// Uses the passability as it was at the last update().
+	std::vector<PFPos> findPath(PFPos start, PFPos end) const;
+
+	size_t getNumEntrances() const;
+	int getNumTilesX() const { return numTilesX; }
+	int getNumTilesZ() const { return numTilesZ; }
+	// passabilityChangeCounter of the game state at the last update
+	uint64_t getUpdatedAt() const { return updatedAt; }
+	// Passability at the last update, tiles outside of the map are blocked
+	bool isBlocked(int tx, int tz) const {
+		if (tx < 0 || tx >= numTilesX || tz < 0 || tz >= numTilesZ)
+			return true;
+		return blocked.get((size_t)tz * numTilesX + tx);
+	}
+
+private:
+	static constexpr int UNREACHABLE = -1;
+
+	struct Entrance {
+		PFPos pos;
+		PFPos partner; // tile on the other side of the border, entrance of the neighbouring cluster
+	};
+	struct Cluster {
+		int x0, z0, x1, z1; // tile bounds, x1 and z1 excluded
+		std::vector<Entrance> entrances;
+		std::vector<int> distances; // entrances.size()^2 costs between the entrances, UNREACHABLE if no path in the cluster
+		uint64_t builtAt = 0; // passabilityChangeCounter when built
+		bool built = false;
+	};
+
+	const CommonGameState* gameState = nullptr;
+	CommonGameState::MovementClass movementClass = CommonGameState::MOVEMENT_LAND;
+	int numTilesX = 0, numTilesZ = 0;
+	CommonGameState::TileBits blocked; // copy of gameState->tileBlocked[movementClass] at the last update
+	int numClustersX = 0, numClustersZ = 0;
+	std::vector<Cluster> clusters;
+	uint64_t updatedAt = 0; // passabilityChangeCounter at the last update
+	bool upToDate = false;
+
+	int getClusterIndex(PFPos pos) const { return (pos.z >> CLUSTER_SHIFT) * numClustersX + (pos.x >> CLUSTER_SHIFT); }
+	bool needsRebuild(int cx, int cz) const;
+	void buildCluster(int cx, int cz);
+	// Calls func(a, b) for every entrance on the border between the cluster and the one on its right (vertical = false)
+	// or below it (vertical = true), a being the tile in the cluster and b the one in the neighbour
+	template <typename Func> void forEachBorderEntrance(int cx, int cz, bool vertical, Func func) const;
+	// Costs from the tile to all tiles of its cluster, staying in the cluster (UNREACHABLE if not reachable)
+	void computeCostsInCluster(const Cluster& cluster, PFPos from, std::vector<int>& costs) const;
+	// Returns the index of the matching entrance in the neighbouring cluster, or -1
+	int findPartner(const Entrance& entrance) const;
+};
@@ -0,0 +1,167 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#include "JobSystem.h"
+#include "settings.h"
+#include <nlohmann/json.hpp>
+#include <cassert>
+
+namespace {
+	// Job system and queue of the current thread if it is a worker
+	thread_local const JobSystem* t_workerSystem = nullptr;
+	thread_local size_t t_workerQueue = 0;
+}
+
+JobSystem& JobSystem::instance()
+{
+	static JobSystem jobSystem([]() {
+		int numThreads = -1;
+		if (g_settings.is_object())
+			numThreads = g_settings.value<int>("jobThreads", numThreads);
+		if (numThreads < 0)
+			numThreads = std::max(1, (int)std::thread::hardware_concurrency()) - 1;
+		return numThreads;
+	}());
+	return jobSystem;
+}
+
+JobSystem::JobSystem(int numThreads)
+{
+	numThreads = std::max(numThreads, 0);
+	for (int i = 0; i <= numThreads; i++)
+		m_queues.push_back(std::make_unique<WorkQueue>());
+	for (int i = 0; i < numThreads; i++)
+		m_workers.emplace_back(&JobSystem::workerLoop, this, (size_t)(i + 1));
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stopping = true;
+	}
+	m_wakeUp.notify_all();
+	for (std::thread& worker : m_workers)
+		worker.join();
+}
+
+size_t JobSystem::getCurrentQueueIndex() const
+{
+	return (t_workerSystem == this) ? t_workerQueue : 0;
+}
+
+void JobSystem::run(JobFunc func, JobCounter* counter)
+{
+	if (m_workers.empty()) {
+		func();
+		return;
+	}
+	if (counter)
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	WorkQueue& queue = *m_queues[getCurrentQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back({ std::move(func), counter });
+	}
+	m_numQueuedJobs.fetch_add(1, std::memory_order_release);
+	{
+		// so that a worker can't miss the new job between checking the count and sleeping
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	m_wakeUp.notify_one();
+}
+
+bool JobSystem::popJob(size_t queueIndex, Job& job)
+{
+	WorkQueue& queue = *m_queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty())
+		return false;
+	job = std::move(queue.jobs.back());
+	queue.jobs.pop_back();
+	return true;
+}
+
+bool JobSystem::stealJob(size_t thiefIndex, Job& job)
+{
+	const size_t numQueues = m_queues.size();
+	for (size_t i = 1; i < numQueues; i++) {
+		WorkQueue& queue = *m_queues[(thiefIndex + i) % numQueues];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JobSystem::runOneJob(size_t queueIndex)
+{
+	Job job;
+	if (!popJob(queueIndex, job) && !stealJob(queueIndex, job))
+		return false;
+	m_numQueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	job.func();
+	if (job.counter)
+		job.counter->pending.fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	const size_t queueIndex = getCurrentQueueIndex();
+	while (!counter.isDone()) {
+		if (!runOneJob(queueIndex))
+			std::this_thread::yield(); // the last jobs are being run by other threads
+	}
+}
+
+void JobSystem::workerLoop(size_t queueIndex)
+{
+	t_workerSystem = this;
+	t_workerQueue = queueIndex;
+	while (true) {
+		if (runOneJob(queueIndex))
+			continue;
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wakeUp.wait(lock, [this]() { return m_stopping || m_numQueuedJobs.load(std::memory_order_acquire) > 0; });
+		if (m_stopping)
+			return;
+	}
+}
+
+size_t JobGraph::add(JobSystem::JobFunc func)
+{
+	m_nodes.emplace_back().func = std::move(func);
+	return m_nodes.size() - 1;
+}
+
+void JobGraph::addDependency(size_t before, size_t after)
+{
+	assert(before < m_nodes.size() && after < m_nodes.size() && before != after);
+	m_nodes[before].successors.push_back(after);
+	m_nodes[after].numDependencies++;
+}
+
+void JobGraph::runNode(JobSystem& jobSystem, size_t index, JobCounter& counter)
+{
+	Node& node = m_nodes[index];
+	node.func();
+	for (size_t next : node.successors)
+		if (m_nodes[next].remainingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			jobSystem.run([this, &jobSystem, next, &counter]() { runNode(jobSystem, next, counter); }, &counter);
+}
+
+void JobGraph::run(JobSystem& jobSystem)
+{
+	for (Node& node : m_nodes)
+		node.remainingDependencies.store(node.numDependencies, std::memory_order_relaxed);
+	JobCounter counter;
+	for (size_t i = 0; i < m_nodes.size(); i++)
+		if (m_nodes[i].numDependencies == 0)
+			jobSystem.run([this, &jobSystem, i, &counter]() { runNode(jobSystem, i, counter); }, &counter);
+	jobSystem.wait(counter);
+}
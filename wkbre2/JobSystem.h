@@ -0,0 +1,118 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the jobs that are not finished yet, to wait for a group of jobs
+struct JobCounter {
+	std::atomic<int> pending{ 0 };
+	bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Pool of worker threads shared by all the subsystems.
+// Every worker has its own queue: it takes the jobs from the back of it (newest first, still hot in the cache),
+// and when empty steals the oldest jobs from the front of the other queues.
+// A thread waiting for jobs helps running them instead of sleeping, so jobs can start and wait for other jobs.
+// With 0 worker threads, the jobs are run immediately by the thread that queues them.
+// The number of worker threads is "jobThreads" in wkconfig.json (default: number of cores - 1).
+class JobSystem
+{
+public:
+	using JobFunc = std::function<void()>;
+
+	static JobSystem& instance();
+
+	explicit JobSystem(int numThreads);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	size_t getNumWorkers() const { return m_workers.size(); }
+
+	// Queues a job, the counter (if any) is decremented when the job is finished
+	void run(JobFunc func, JobCounter* counter = nullptr);
+
+	// Runs queued jobs until the counter reaches 0
+	void wait(JobCounter& counter);
+
+	// Calls func(first, last) for consecutive ranges covering [begin, end[, at most grainSize indices each,
+	// and returns when all are done. func must be safe to call concurrently on different ranges.
+	template <typename Func> void parallelFor(size_t begin, size_t end, size_t grainSize, const Func& func) {
+		if (begin >= end)
+			return;
+		grainSize = std::max<size_t>(grainSize, 1);
+		if (end - begin <= grainSize || m_workers.empty()) {
+			func(begin, end);
+			return;
+		}
+		JobCounter counter;
+		// the first range is run by this thread, after queuing the others
+		for (size_t first = begin + grainSize; first < end; first += grainSize) {
+			const size_t last = std::min(end, first + grainSize);
+			run([&func, first, last]() { func(first, last); }, &counter);
+		}
+		func(begin, begin + grainSize);
+		wait(counter);
+	}
+
+private:
+	struct Job {
+		JobFunc func;
+		JobCounter* counter;
+	};
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	// queue 0 is for the threads that are not workers, queue i+1 for worker i
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+	std::atomic<int> m_numQueuedJobs{ 0 };
+	std::atomic<bool> m_stopping{ false };
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wakeUp;
+
+	size_t getCurrentQueueIndex() const;
+	bool popJob(size_t queueIndex, Job& job);
+	bool stealJob(size_t thiefIndex, Job& job);
+	bool runOneJob(size_t queueIndex);
+	void workerLoop(size_t queueIndex);
+};
+
+// Jobs with dependencies between them. A job starts once all the jobs it depends on are finished.
+// The graph can be run several times.
+class JobGraph
+{
+public:
+	// Adds a job and returns its index
+	size_t add(JobSystem::JobFunc func);
+	// The job "after" will only start when the job "before" is finished
+	void addDependency(size_t before, size_t after);
+	// Runs all jobs of the graph and returns once they are all finished
+	void run(JobSystem& jobSystem);
+	size_t size() const { return m_nodes.size(); }
+
+private:
+	struct Node {
+		JobSystem::JobFunc func;
+		std::vector<size_t> successors;
+		int numDependencies = 0;
+		std::atomic<int> remainingDependencies{ 0 };
+	};
+	std::deque<Node> m_nodes; // deque, as the atomics can't be moved
+
+	void runNode(JobSystem& jobSystem, size_t index, JobCounter& counter);
+};
@@ -47,42 +47,12 @@ Vector3 MovementController::startMovement(const Vector3& destination)
 	//m_pathNodes = { destination };
 
 	using namespace Pathfinding;
-	Terrain* trn = Server::instance->terrain;
-	auto& tiles = Server::instance->tiles;
+	Server* server = Server::instance;
+	Terrain* trn = server->terrain;
 	auto trnsize = trn->getNumPlayableTiles();
-	auto pred = [&](PFPos pfp) -> bool {
-		if (!(pfp.x >= 0 && pfp.x < trnsize.first && pfp.z >= 0 && pfp.z < trnsize.second))
-			return true;
-
-		const auto& tile = tiles[pfp.z * trnsize.first + pfp.x];
-		if (tile.building.getFrom<Server>() && !tile.buildingPassable)
-			return true;
-
-		const auto* trnTile = trn->getPlayableTile(pfp.x, pfp.z);
-		if (trnTile) {
-			const float h[4] = {
-				trn->getVertex(trn->edge + pfp.x, trn->edge + pfp.z),
-				trn->getVertex(trn->edge + pfp.x + 1, trn->edge + pfp.z),
-				trn->getVertex(trn->edge + pfp.x, trn->edge + pfp.z + 1),
-				trn->getVertex(trn->edge + pfp.x + 1, trn->edge + pfp.z + 1)
-			};
-			auto [minH, maxH] = std::minmax_element(std::begin(h), std::end(h));
-
-			const bool waterUnit = m_object->blueprint->canWalkOnWater() && m_object->blueprint->bpClass != Tags::GAMEOBJCLASS_FORMATION;
-			if (waterUnit && !trnTile->fullOfWater)
-				return true;
-
-			if (!waterUnit && trnTile->fullOfWater) {
-				if (trnTile->waterLevel - *minH > 1.5f)
-					return true;
-			}
-
-			// no gradients above 45 degrees
-			if (!waterUnit && *maxH - *minH > 5.0f)
-				return true;
-		}
-
-		return false;
+	const auto movementClass = CommonGameState::getMovementClass(m_object->blueprint);
+	auto pred = [server, movementClass](PFPos pfp) -> bool {
+		return server->isTileBlocked(movementClass, pfp.x, pfp.z);
 	};
 
 	PFPos posStart{ (int)(m_object->position.x / 5.0f), (int)(m_object->position.z / 5.0f) };
@@ -124,28 +94,42 @@ Vector3 MovementController::startMovement(const Vector3& destination)
 
 	auto rtres = SegmentTraversal(m_object->position.x / 5.0f, m_object->position.z / 5.0f, realDestination.x / 5.0f, realDestination.z / 5.0f, pred);
 	if (!rtres) {
+		m_pathRequest = 0;
 		m_pathNodes = { realDestination, m_object->position };
 		m_object->startMovement(m_pathNodes[0]);
 		m_started = true;
 	}
 	else {
-		auto tileList = DoPathfinding(posStart, posEnd, pred, ManhattanDiagHeuristic);
-		if (tileList.size() >= 1) {
-			m_pathNodes.clear();
-			m_pathNodes.emplace_back(realDestination);
-			for (PFPos& pfp : tileList) {
-				m_pathNodes.emplace_back(pfp.x * 5.0f + 2.5f, m_object->position.y, pfp.z * 5.0f + 2.5f);
-			}
-			m_object->startMovement(m_pathNodes[m_pathNodes.size() - 2]);
-			m_started = true;
-		}
-		else
-			stopMovement();
+		// a unit that is already moving continues on its previous path in the meantime
+		m_pendingDestination = realDestination;
+		m_pathRequest = server->requestPath(m_object, movementClass, posStart, posEnd);
 	}
 	return realDestination;
 }
 
+void MovementController::applyPath(const std::vector<Pathfinding::PFPos>& tileList)
+{
+	m_pathRequest = 0;
+	if (tileList.empty()) {
+		stopMovement();
+		return;
+	}
+	m_pathNodes.clear();
+	m_pathNodes.emplace_back(m_pendingDestination);
+	for (const Pathfinding::PFPos& pfp : tileList) {
+		m_pathNodes.emplace_back(pfp.x * 5.0f + 2.5f, m_object->position.y, pfp.z * 5.0f + 2.5f);
+	}
+	m_object->startMovement(m_pathNodes[m_pathNodes.size() - 2]);
+	m_started = true;
+}
+
 void MovementController::stopMovement()
+{
+	stopFollowingPath();
+	m_pathRequest = 0;
+}
+
+void MovementController::stopFollowingPath()
 {
 	m_object->stopMovement();
 	m_pathNodes.clear();
@@ -162,6 +146,6 @@ void MovementController::updateMovement()
 			m_object->startMovement(m_pathNodes[m_pathNodes.size() - 2]);
 		}
 		else
-			stopMovement();
+			stopFollowingPath(); // a new path might still be coming
 	}
 }
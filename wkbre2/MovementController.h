@@ -4,24 +4,36 @@
 
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include "util/vecmat.h"
 #include "Movement.h"
+#include "Pathfinding.h"
 
 struct ServerGameObject;
 
 struct MovementController {
+	// If the destination can't be reached in a straight line, the path is searched by the server after the tick,
+	// and the unit keeps its current path (or stays still) until the path is applied at the next tick
 	Vector3 startMovement(const Vector3& destination);
 	void stopMovement();
 	void updateMovement();
+	// Called by the server with the result of the path request (tiles from end to start, empty if not found)
+	void applyPath(const std::vector<Pathfinding::PFPos>& tileList);
 	//Vector3 getPosition(float time) const;
-	bool isMoving() const { return m_started; }
+	bool isMoving() const { return m_started || isWaitingForPath(); }
+	bool isWaitingForPath() const { return m_pathRequest != 0; }
 	//Vector3 getDirection() const { return (m_pathNodes[m_pathNodes.size()-1] - m_pathNodes.back()).normal2xz(); }
-	Vector3 getDestination() const { return m_pathNodes.front(); }
+	Vector3 getDestination() const { return isWaitingForPath() ? m_pendingDestination : m_pathNodes.front(); }
 
 	MovementController(ServerGameObject* object) : m_object(object) {}
 
 	bool m_started = false;
 	std::vector<Vector3> m_pathNodes;
 	ServerGameObject* m_object;
+	uint32_t m_pathRequest = 0; // sequence number of the path request not applied yet, 0 if none
+	Vector3 m_pendingDestination;
+
+private:
+	void stopFollowingPath();
 };
\ No newline at end of file
@@ -6,7 +6,11 @@
 #include "server.h"
 #include "client.h"
 #include "terrain.h"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <queue>
 
 void NNSearch::start(CommonGameState* server, const Vector3 &center, float radius)
 {
@@ -39,3 +43,214 @@ CommonGameObject* NNSearch::next()
 		it = 0;
 	}
 }
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NNSEARCH_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define NNSEARCH_NEON
+#endif
+
+namespace {
+	// Writes the indices of the points (xs[i], zs[i]) inside the circle, returns the number of indices.
+	// The arrays must have room for a multiple of 4 points.
+	size_t FilterInCircle(const float* xs, const float* zs, size_t count, float cx, float cz, float radiusSq, uint8_t* indices)
+	{
+		size_t numInside = 0;
+#if defined(NNSEARCH_SSE2)
+		const __m128 vcx = _mm_set1_ps(cx), vcz = _mm_set1_ps(cz), vr2 = _mm_set1_ps(radiusSq);
+		for (size_t i = 0; i < count; i += 4) {
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), vcx);
+			__m128 dz = _mm_sub_ps(_mm_loadu_ps(zs + i), vcz);
+			__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+			const int mask = _mm_movemask_ps(_mm_cmple_ps(d2, vr2));
+			const size_t numLanes = std::min<size_t>(4, count - i);
+			for (size_t lane = 0; lane < numLanes; lane++)
+				if (mask & (1 << lane))
+					indices[numInside++] = (uint8_t)(i + lane);
+		}
+#elif defined(NNSEARCH_NEON)
+		const float32x4_t vcx = vdupq_n_f32(cx), vcz = vdupq_n_f32(cz), vr2 = vdupq_n_f32(radiusSq);
+		for (size_t i = 0; i < count; i += 4) {
+			float32x4_t dx = vsubq_f32(vld1q_f32(xs + i), vcx);
+			float32x4_t dz = vsubq_f32(vld1q_f32(zs + i), vcz);
+			float32x4_t d2 = vmlaq_f32(vmulq_f32(dx, dx), dz, dz);
+			uint32_t inside[4];
+			vst1q_u32(inside, vcleq_f32(d2, vr2));
+			const size_t numLanes = std::min<size_t>(4, count - i);
+			for (size_t lane = 0; lane < numLanes; lane++)
+				if (inside[lane])
+					indices[numInside++] = (uint8_t)(i + lane);
+		}
+#else
+		for (size_t i = 0; i < count; i++) {
+			float dx = xs[i] - cx, dz = zs[i] - cz;
+			if (dx * dx + dz * dz <= radiusSq)
+				indices[numInside++] = (uint8_t)i;
+		}
+#endif
+		return numInside;
+	}
+}
+
+void NNCircleSearch::start(CommonGameState* gameState, const Vector3& center, float radius, uint32_t classMask)
+{
+	this->gameState = gameState;
+	this->classMask = classMask;
+	centerX = center.x; centerZ = center.z;
+	radiusSq = radius * radius;
+	auto area = gameState->terrain->getNumPlayableTiles();
+	// clamped as float first, so that huge radiuses don't overflow the int
+	auto tileCoord = [](float v, int lim) { return (int)std::floor(std::clamp(v / 5.0f, -1.0f, (float)lim)); };
+	minX = std::max(0, tileCoord(center.x - radius, area.first));
+	minZ = std::max(0, tileCoord(center.z - radius, area.second));
+	maxX = std::min(area.first - 1, tileCoord(center.x + radius, area.first));
+	maxZ = std::min(area.second - 1, tileCoord(center.z + radius, area.second));
+	tx = minX; tz = minZ; it = 0;
+	finished = !gameState->tiles || !(radius >= 0.0f) || minX > maxX || minZ > maxZ;
+	if (!finished && !tileIsWanted(tx, tz))
+		nextTile();
+}
+
+void NNCircleSearch::nextTile()
+{
+	it = 0;
+	do {
+		if (++tx > maxX) { tx = minX; ++tz; }
+		if (tz > maxZ) { finished = true; return; }
+	} while (!tileIsWanted(tx, tz));
+}
+
+bool NNCircleSearch::tileIsWanted(int x, int z)
+{
+	// if the block is empty, go directly to its last tile in the row
+	for (int level = CommonGameState::NUM_TILE_BLOCK_LEVELS - 1; level >= 0; level--) {
+		if (!(gameState->getTileBlock(level, x, z).classMask & classMask)) {
+			const int shift = CommonGameState::TILE_BLOCK_SHIFT[level];
+			tx = std::min(maxX, (((x >> shift) + 1) << shift) - 1);
+			return false;
+		}
+	}
+	return tileTouchesCircle(x, z);
+}
+
+bool NNCircleSearch::tileTouchesCircle(int x, int z) const
+{
+	// distance between the center and the nearest point of the tile
+	float dx = std::max({ x * 5.0f - centerX, 0.0f, centerX - (x + 1) * 5.0f });
+	float dz = std::max({ z * 5.0f - centerZ, 0.0f, centerZ - (z + 1) * 5.0f });
+	return dx * dx + dz * dz <= radiusSq;
+}
+
+size_t NNCircleSearch::nextBatch(CommonGameObject** objects)
+{
+	// positions of the candidates, padded for the 4-wide tests
+	alignas(16) float xs[BATCH_SIZE + 3] = {}, zs[BATCH_SIZE + 3] = {};
+	CommonGameObject* candidates[BATCH_SIZE];
+	uint8_t indices[BATCH_SIZE];
+	const int numTilesX = gameState->terrain->getNumPlayableTiles().first;
+	// loop until something is found, as a whole batch of candidates can be outside of the circle
+	while (!finished) {
+		size_t numCandidates = 0;
+		while (!finished && numCandidates < BATCH_SIZE) {
+			const auto& vec = gameState->tiles[tz * numTilesX + tx].objList;
+			for (; it < vec.size() && numCandidates < BATCH_SIZE; it++) {
+				CommonGameObject* obj = vec[it].getFrom(gameState);
+				if (obj && (classMask & (1u << obj->blueprint->bpClass))) {
+					xs[numCandidates] = obj->position.x;
+					zs[numCandidates] = obj->position.z;
+					candidates[numCandidates++] = obj;
+				}
+			}
+			if (it < vec.size())
+				break; // batch full, continue from here next time
+			nextTile();
+		}
+		size_t numFound = FilterInCircle(xs, zs, numCandidates, centerX, centerZ, radiusSq, indices);
+		for (size_t i = 0; i < numFound; i++)
+			objects[i] = candidates[indices[i]];
+		if (numFound > 0)
+			return numFound;
+	}
+	return 0;
+}
+
+std::vector<CommonGameObject*> NNNearestSearch::find(CommonGameState* gameState, const Vector3& center, float maxRadius, size_t k,
+	const Predicate& pred, uint32_t classMask)
+{
+	std::vector<CommonGameObject*> found;
+	if (!gameState->tiles || k == 0 || !(maxRadius >= 0.0f))
+		return found;
+	auto area = gameState->terrain->getNumPlayableTiles();
+	const int numTilesX = area.first, numTilesZ = area.second;
+	const float maxRadiusSq = maxRadius * maxRadius;
+	const int ctx = (int)std::floor(std::clamp(center.x / 5.0f, -1.0f, (float)numTilesX));
+	const int ctz = (int)std::floor(std::clamp(center.z / 5.0f, -1.0f, (float)numTilesZ));
+	// rings after the last one are either outside of the map or farther than the max radius
+	const int mapRings = std::max({ ctx + 1, numTilesX - ctx, ctz + 1, numTilesZ - ctz });
+	const int lastRing = std::min(mapRings, (int)std::min(maxRadius / 5.0f + 1.0f, (float)mapRings));
+
+	// Candidates waiting for the rings around them to be visited, nearest first.
+	// Ties are ordered by visit order, so that the result doesn't depend on the heap.
+	struct Candidate {
+		float distSq;
+		size_t order;
+		CommonGameObject* obj;
+		bool operator<(const Candidate& other) const {
+			return (distSq != other.distSq) ? (distSq > other.distSq) : (order > other.order);
+		}
+	};
+	std::priority_queue<Candidate> candidates;
+	size_t numVisited = 0;
+
+	auto visitTile = [&](int x, int z) {
+		if (x < 0 || x >= numTilesX || z < 0 || z >= numTilesZ)
+			return;
+		if (!(gameState->getTileBlock(0, x, z).classMask & classMask))
+			return;
+		for (const auto& ref : gameState->tiles[z * numTilesX + x].objList) {
+			CommonGameObject* obj = ref.getFrom(gameState);
+			if (!obj || !(classMask & (1u << obj->blueprint->bpClass)))
+				continue;
+			const float distSq = (obj->position - center).sqlen2xz();
+			if (distSq <= maxRadiusSq)
+				candidates.push({ distSq, numVisited++, obj });
+		}
+	};
+
+	for (int ring = 0; ring <= lastRing; ring++) {
+		if (ring == 0)
+			visitTile(ctx, ctz);
+		else {
+			for (int x = ctx - ring; x <= ctx + ring; x++) {
+				visitTile(x, ctz - ring);
+				visitTile(x, ctz + ring);
+			}
+			for (int z = ctz - ring + 1; z <= ctz + ring - 1; z++) {
+				visitTile(ctx - ring, z);
+				visitTile(ctx + ring, z);
+			}
+		}
+		// the objects of the next rings are at least this far, as the center is in the center tile
+		const float nextRingDist = ring * 5.0f;
+		const bool lastOne = (ring == lastRing);
+		while (!candidates.empty() && (lastOne || candidates.top().distSq <= nextRingDist * nextRingDist)) {
+			CommonGameObject* obj = candidates.top().obj;
+			candidates.pop();
+			if (pred(obj)) {
+				found.push_back(obj);
+				if (found.size() >= k)
+					return found;
+			}
+		}
+	}
+	return found;
+}
+
+CommonGameObject* NNNearestSearch::findFirst(CommonGameState* gameState, const Vector3& center, float maxRadius,
+	const Predicate& pred, uint32_t classMask)
+{
+	auto found = find(gameState, center, maxRadius, 1, pred, classMask);
+	return found.empty() ? nullptr : found[0];
+}
@@ -5,11 +5,16 @@
 #pragma once
 
 #include "util/vecmat.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
 
 struct CommonGameState;
 struct CommonGameObject;
 
-// Find all objects in the requested circle
+// Find all objects in the tiles covering the requested circle
+// (so also some objects outside of the circle, see NNCircleSearch for an exact search)
 struct NNSearch {
 	CommonGameState* gameState;
 
@@ -22,4 +27,57 @@ struct NNSearch {
 	void start(CommonGameState* server, const Vector3& center, float radius);
 	// Returns the next found object, or nullptr if no more objects found.
 	CommonGameObject* next();
-};
\ No newline at end of file
+};
+
+// Find the objects whose distance to the center on the XZ plane is at most the radius.
+// Tiles completely outside of the circle and blocks of tiles without objects of the wanted classes
+// are skipped, and the positions of the objects in the other tiles are gathered and tested
+// in batches (with SSE2/NEON if available).
+struct NNCircleSearch {
+	static constexpr size_t BATCH_SIZE = 64;
+	static constexpr uint32_t ALL_CLASSES = ~0u;
+
+	// Starts the search. classMask has the bits (1 << class) of the object classes to find.
+	void start(CommonGameState* gameState, const Vector3& center, float radius, uint32_t classMask = ALL_CLASSES);
+	// Puts the next found objects in the array (at most BATCH_SIZE), and returns how many were put.
+	// Returns 0 if no more objects found.
+	size_t nextBatch(CommonGameObject** objects);
+
+	// Calls func(obj) for every object in the circle, without storing all of them
+	template <typename Func> static void forEach(CommonGameState* gameState, const Vector3& center, float radius, Func func, uint32_t classMask = ALL_CLASSES) {
+		NNCircleSearch search;
+		search.start(gameState, center, radius, classMask);
+		CommonGameObject* batch[BATCH_SIZE];
+		while (size_t count = search.nextBatch(batch))
+			for (size_t i = 0; i < count; i++)
+				func(batch[i]);
+	}
+
+private:
+	CommonGameState* gameState;
+	float centerX, centerZ, radiusSq;
+	uint32_t classMask;
+	int minX, minZ, maxX, maxZ;
+	int tx, tz;
+	size_t it;
+	bool finished;
+
+	bool tileTouchesCircle(int x, int z) const;
+	bool tileIsWanted(int x, int z);
+	void nextTile();
+};
+
+// Find the objects nearest to the center on the XZ plane (up to maxRadius) for which pred(obj) is true.
+// The tiles are visited in rings around the center, and an object is only given to pred once it is
+// nearer than all objects of the rings not visited yet, so pred is called in distance order
+// and the search stops as soon as k objects are accepted.
+struct NNNearestSearch {
+	using Predicate = std::function<bool(CommonGameObject*)>;
+
+	// Returns the accepted objects, nearest first
+	static std::vector<CommonGameObject*> find(CommonGameState* gameState, const Vector3& center, float maxRadius, size_t k,
+		const Predicate& pred, uint32_t classMask = NNCircleSearch::ALL_CLASSES);
+	// Returns the nearest accepted object, or nullptr if none
+	static CommonGameObject* findFirst(CommonGameState* gameState, const Vector3& center, float maxRadius,
+		const Predicate& pred, uint32_t classMask = NNCircleSearch::ALL_CLASSES);
+};
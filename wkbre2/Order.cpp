@@ -13,6 +13,8 @@
 #include "gameset/gameset.h"
 #include "terrain.h"
 #include "NNSearch.h"
+#include <algorithm>
+#include <cmath>
 
 void Order::init()
 {
@@ -315,6 +317,7 @@ Order* OrderConfiguration::addOrder(const OrderBlueprint* orderBlueprint, int as
 		neworder = &this->orders.back();
 		break;
 	}
+	Server::instance->activeObjects[Server::ACTIVE_ORDERS].add(gameobj);
 	for (TaskBlueprint* taskBp : orderBlueprint->tasks) {
 		int id = neworder->nextTaskId++;
 		neworder->tasks.push_back(Task::create(id, taskBp, neworder));
@@ -373,13 +376,13 @@ void Trigger::parse(GSFileParser &gsf, const GameSet &gs)
 void TimerTrigger::init()
 {
 	SrvScriptContext ctx(Server::instance, this->task->order->gameObject);
-	period = this->blueprint->period->eval(&ctx);
-	referenceTime = Server::instance->timeManager.currentTime;
+	period = (uint32_t)std::lround(std::max(0.0f, this->blueprint->period->eval(&ctx)) * 1000.0f);
+	referenceTime = Server::instance->timeManager.psCurrentTime;
 }
 
 void TimerTrigger::update()
 {
-	if (Server::instance->timeManager.currentTime >= referenceTime + period) {
+	if (Server::instance->timeManager.psCurrentTime >= referenceTime + period) {
 		this->blueprint->actions.run(this->task->order->gameObject);
 		//TimerTrigger::init();
 		this->referenceTime += this->period;
@@ -392,9 +395,9 @@ void TimerTrigger::parse(GSFileParser & gsf, const GameSet & gs)
 	while (!gsf.eof) {
 		std::string word = gsf.nextTag();
 		if (word == "PERIOD")
-			period = gsf.nextFloat();
+			period = (uint32_t)std::lround(gsf.nextFloat() * 1000.0f);
 		else if (word == "REFERENCE_TIME")
-			referenceTime = gsf.nextFloat();
+			referenceTime = (uint32_t)std::lround(gsf.nextFloat() * 1000.0f);
 		else if (word == "END_TRIGGER")
 			break;
 		gsf.advanceLine();
@@ -552,19 +555,24 @@ void MissileTask::onUpdate()
 	msPrevPosition = go->position;
 
 	// unit collision
-	NNSearch nns;
-	nns.start(Server::instance, go->position, 15.0f);
-	while (ServerGameObject* col = (ServerGameObject*)nns.next()) {
-		if (col->blueprint->bpClass == Tags::GAMEOBJCLASS_BUILDING || col->blueprint->bpClass == Tags::GAMEOBJCLASS_CHARACTER) {
-			if (col->getPlayer() != go->getPlayer() && col->isInteractable()) {
-				if (Model* model = col->blueprint->getModel(col->subtype, col->appearance, col->animationIndex, col->animationVariant)) {
-					Vector3 sCenter = model->getSphereCenter().transform(col->getWorldMatrix());
-					float sRadius = model->getSphereRadius();
-					if (LineSegmentIntersectsSphere(prevPosition, go->position, sCenter, sRadius)) {
-						SrvScriptContext ctx(Server::instance, go);
-						auto _ = ctx.change(ctx.collisionSubject, col);
-						this->blueprint->collisionTrigger.run(&ctx);
-						return;
+	// large enough for the centers of big buildings whose sphere can be hit
+	NNCircleSearch nns;
+	nns.start(Server::instance, go->position, 25.0f, (1u << Tags::GAMEOBJCLASS_BUILDING) | (1u << Tags::GAMEOBJCLASS_CHARACTER));
+	CommonGameObject* found[NNCircleSearch::BATCH_SIZE];
+	while (size_t numFound = nns.nextBatch(found)) {
+		for (size_t i = 0; i < numFound; i++) {
+			ServerGameObject* col = (ServerGameObject*)found[i];
+			if (col->blueprint->bpClass == Tags::GAMEOBJCLASS_BUILDING || col->blueprint->bpClass == Tags::GAMEOBJCLASS_CHARACTER) {
+				if (col->getPlayer() != go->getPlayer() && col->isInteractable()) {
+					if (Model* model = col->blueprint->getModel(col->subtype, col->appearance, col->animationIndex, col->animationVariant)) {
+						Vector3 sCenter = model->getSphereCenter().transform(col->getWorldMatrix());
+						float sRadius = model->getSphereRadius();
+						if (LineSegmentIntersectsSphere(prevPosition, go->position, sCenter, sRadius)) {
+							SrvScriptContext ctx(Server::instance, go);
+							auto _ = ctx.change(ctx.collisionSubject, col);
+							this->blueprint->collisionTrigger.run(&ctx);
+							return;
+						}
 					}
 				}
 			}
@@ -142,7 +142,7 @@ struct Trigger {
 };
 
 struct TimerTrigger : Trigger {
-	float period, referenceTime;
+	uint32_t period, referenceTime; // in milliseconds
 	using Trigger::Trigger;
 	void init() override;
 	void update() override;
@@ -45,15 +45,15 @@ void ParticleContainer::generate(ParticleSystem* system, const Vector3& position
 		particle.startPosition = position;
 
 		float maxAngle = system->State_Generation.Velocity.Direction.Cone * 3.141f / 180.0f;
-		float angX = (((float)rand() / (float)RAND_MAX) * 2.0f - 1.0f) * maxAngle;
-		float angY = (((float)rand() / (float)RAND_MAX) * 2.0f - 1.0f) * maxAngle;
+		float angX = (random.nextFloat() * 2.0f - 1.0f) * maxAngle;
+		float angY = (random.nextFloat() * 2.0f - 1.0f) * maxAngle;
 		particle.startVelocity = Vector3(0,1,0).transformNormal(Matrix::getRotationXMatrix(angX)).transformNormal(Matrix::getRotationYMatrix(angY));
 		auto& magRange = system->State_Generation.Velocity.Magnitude_Range;
-		particle.startVelocity *= ((float)rand() / (float)RAND_MAX) * (magRange[1] - magRange[0]) + magRange[0];
+		particle.startVelocity *= random.nextFloat() * (magRange[1] - magRange[0]) + magRange[0];
 		particle.objid = objid;
 
 		auto& maxAgeRange = system->Particles.Max_Age_Range;
-		particle.maxAge = ((float)rand() / (float)RAND_MAX) * (maxAgeRange[1] - maxAgeRange[0]) + maxAgeRange[0];
+		particle.maxAge = random.nextFloat() * (maxAgeRange[1] - maxAgeRange[0]) + maxAgeRange[0];
 	}
 }
 
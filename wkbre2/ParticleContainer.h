@@ -8,6 +8,7 @@
 #include <map>
 #include <vector>
 #include "util/vecmat.h"
+#include "util/RandomGenerator.h"
 
 struct ParticleSystem;
 
@@ -35,6 +36,7 @@ struct ParticleContainer {
 
 	std::map<void*, std::vector<Particle>> particles;
 	std::map<uint32_t, Trail> trails;
+	RandomGenerator random; // own generator, particles must not change the simulation's random sequence
 
 	void clearParticles() { particles.clear(); }
 
@@ -4,11 +4,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <limits>
-#include <map>
 #include <optional>
-#include <set>
+#include <vector>
 //#include <iostream>
 
 namespace Pathfinding {
@@ -36,75 +37,103 @@ namespace Pathfinding {
         return (int)(std::sqrt((float)(n.x - o.x) * (n.x - o.x) + (float)(n.z - o.z) * (n.z - o.z)) * 100.0f);
     }
 
+    // A* on a grid of width x height tiles.
+    // The state of the tiles is in flat arrays that are kept from one search to the next.
+    // A tile whose generation is not the one of the current search has not been reached yet,
+    // so starting a new search doesn't need to clear the arrays.
+    // The open tiles are in a binary heap where every tile knows its position, so a tile
+    // that gets a better score is moved up in the heap instead of being added again.
+    // The arrays have a border of 1 tile around the grid, so searches can also start
+    // and end just outside of the grid (the tiles further away are considered blocked).
     struct AStarPathfinder {
         using score_t = int;
-        //using pfp_set = std::set<PFPos>;
-        //template<typename T> using pfp_map = std::map<PFPos, T>;
-        using pfp_set = std::unordered_set<PFPos, PFPos::Hasher>;
-        template<typename T> using pfp_map = std::unordered_map<PFPos, T, PFPos::Hasher>;
-        std::vector<std::pair<PFPos, score_t>> nextTiles;
-        pfp_set visited;
-        pfp_map<int> scores;
-        pfp_map<PFPos> edges;
+        struct Node {
+            uint32_t generation = 0;
+            score_t score;    // cost from the start
+            score_t priority; // score + heuristic
+            int parent;       // node index
+            int heapIndex;    // -1 if not in the heap
+            bool closed;
+        };
+        std::vector<Node> nodes;
+        std::vector<int> heap; // node indices
+        uint32_t generation = 0;
+        int width = 0, height = 0; // including the border
         PFPos start, end;
         bool finished = false;
         bool nothingFound = false;
 
-        void begin(PFPos start, PFPos end) {
-            visited.clear();
-            scores.clear();
-            edges.clear();
+        bool isInArea(PFPos p) const { return p.x >= -1 && p.x < width - 1 && p.z >= -1 && p.z < height - 1; }
+        int getIndex(PFPos p) const { return (p.z + 1) * width + (p.x + 1); }
+        PFPos getPos(int index) const { return { index % width - 1, index / width - 1 }; }
+
+        void begin(int gridWidth, int gridHeight, PFPos start, PFPos end) {
+            if (width != gridWidth + 2 || height != gridHeight + 2) {
+                width = gridWidth + 2;
+                height = gridHeight + 2;
+                nodes.assign((size_t)width * height, Node());
+                generation = 0;
+            }
+            if (++generation == 0) {
+                // wrapped around, the old generations could be taken for the new one
+                for (Node& node : nodes)
+                    node.generation = 0;
+                generation = 1;
+            }
+            heap.clear();
             this->start = start;
             this->end = end;
             finished = false;
             nothingFound = false;
 
-            scores[start] = 0;
-            nextTiles = { {start, 0} };
+            if (!isInArea(start)) {
+                finished = true;
+                nothingFound = true;
+                return;
+            }
+            const int index = getIndex(start);
+            nodes[index] = { generation, 0, 0, index, -1, false };
+            pushHeap(index);
         }
 
         template<typename Predicate, typename Heuristic>
         bool next(Predicate pred, Heuristic heuristic) {
             if (finished) return true;
 
-            static auto heapcmp = [](const auto& a, const auto& b) {return a.second > b.second; };
-
-            // find tile with min score
-            PFPos mt;
-            score_t mscore = std::numeric_limits<score_t>::max();
-            while (!nextTiles.empty()) {
-                std::tie(mt, mscore) = nextTiles.front();
-                std::pop_heap(nextTiles.begin(), nextTiles.end(), heapcmp);
-                nextTiles.pop_back();
-                if (!visited.count(mt))
-                    break;
-            }
-            if (mscore == std::numeric_limits<score_t>::max()) {
-                //std::cout << "FUCK!\n";
+            // take tile with min score
+            if (heap.empty()) {
                 finished = true;
                 nothingFound = true;
                 return true;
             }
-            //printf("%i %i\n", mt.x, mt.z);
+            const int current = popHeap();
+            nodes[current].closed = true;
+            const PFPos mt = getPos(current);
             if (mt == end) {
-                //std::cout << "END REACHED!\n";
                 finished = true;
                 nothingFound = false;
                 return true;
             }
 
             // update neighbours
-            auto updateNeighbour = [this, mt, &pred, &heuristic](int dx, int dz, score_t cost) {
+            const score_t currentScore = nodes[current].score;
+            auto updateNeighbour = [&](int dx, int dz, score_t cost) {
                 PFPos pfp{ mt.x + dx, mt.z + dz };
-                if (!pred(pfp)) {
-                    score_t newscore = scores.at(mt) + cost;
-                    if (!scores.count(pfp) || newscore < scores.at(pfp)) {
-                        scores[pfp] = newscore;
-                        edges[pfp] = mt;
-                        if (!visited.count(pfp)) {
-                            nextTiles.emplace_back(pfp, newscore + heuristic(pfp, end));
-                            std::push_heap(nextTiles.begin(), nextTiles.end(), heapcmp);
-                        }
+                if (!isInArea(pfp) || pred(pfp))
+                    return;
+                const int index = getIndex(pfp);
+                Node& node = nodes[index];
+                const score_t newscore = currentScore + cost;
+                if (node.generation != generation) {
+                    node = { generation, newscore, newscore + heuristic(pfp, end), current, -1, false };
+                    pushHeap(index);
+                }
+                else if (newscore < node.score) {
+                    node.score = newscore;
+                    node.parent = current;
+                    if (!node.closed) {
+                        node.priority = newscore + heuristic(pfp, end);
+                        siftUp(node.heapIndex);
                     }
                 }
             };
@@ -116,7 +145,6 @@ namespace Pathfinding {
             updateNeighbour(-1, 1, 141);
             updateNeighbour(1, -1, 141);
             updateNeighbour(-1, -1, 141);
-            visited.insert(mt);
             return false;
         }
 
@@ -124,30 +152,76 @@ namespace Pathfinding {
             if (nothingFound)
                 return {};
             std::vector<PFPos> vec;
-            PFPos pfp = end;
-            while (pfp != start) {
-                vec.push_back(pfp);
-                pfp = edges.at(pfp);
+            const int startIndex = getIndex(start);
+            int index = getIndex(end);
+            while (index != startIndex) {
+                vec.push_back(getPos(index));
+                index = nodes[index].parent;
             }
             vec.push_back(start);
             return vec;
         }
+
+    private:
+        void setHeapEntry(int heapPos, int index) {
+            heap[heapPos] = index;
+            nodes[index].heapIndex = heapPos;
+        }
+        void siftUp(int heapPos) {
+            const int index = heap[heapPos];
+            const score_t priority = nodes[index].priority;
+            while (heapPos > 0) {
+                const int parentPos = (heapPos - 1) / 2;
+                if (nodes[heap[parentPos]].priority <= priority)
+                    break;
+                setHeapEntry(heapPos, heap[parentPos]);
+                heapPos = parentPos;
+            }
+            setHeapEntry(heapPos, index);
+        }
+        void siftDown(int heapPos) {
+            const int size = (int)heap.size();
+            const int index = heap[heapPos];
+            const score_t priority = nodes[index].priority;
+            while (true) {
+                int child = 2 * heapPos + 1;
+                if (child >= size)
+                    break;
+                if (child + 1 < size && nodes[heap[child + 1]].priority < nodes[heap[child]].priority)
+                    child++;
+                if (priority <= nodes[heap[child]].priority)
+                    break;
+                setHeapEntry(heapPos, heap[child]);
+                heapPos = child;
+            }
+            setHeapEntry(heapPos, index);
+        }
+        void pushHeap(int index) {
+            heap.push_back(index);
+            siftUp((int)heap.size() - 1);
+        }
+        int popHeap() {
+            const int top = heap.front();
+            nodes[top].heapIndex = -1;
+            const int last = heap.back();
+            heap.pop_back();
+            if (!heap.empty()) {
+                setHeapEntry(0, last);
+                siftDown(0);
+            }
+            return top;
+        }
     };
 
+    // Finds a path from start to end on a grid of width x height tiles, pred(pos) returning true for blocked tiles.
+    // Returns the tiles of the path from end to start, or an empty vector if there is no path.
     template<typename Predicate, typename Heuristic>
-    std::vector<PFPos> DoPathfinding(PFPos start, PFPos end, Predicate pred, Heuristic heuristic) {
-        //AStarPathfinder astar;
-        //astar.begin(start, end);
-
-        //while (!astar.next(pred, heuristic));
-
-        //return astar.get();
-
-        AStarPathfinder astar1, astar2;
-        astar1.begin(start, end);
-        astar2.begin(end, start);
+    std::vector<PFPos> DoPathfinding(PFPos start, PFPos end, int width, int height, Predicate pred, Heuristic heuristic) {
+        // searching from both sides, the first one to finish gives the path
+        thread_local AStarPathfinder astar1, astar2;
+        astar1.begin(width, height, start, end);
+        astar2.begin(width, height, end, start);
 
-        bool stop = false;
         while (true) {
             if (astar1.next(pred, heuristic)) return astar1.get();
             if (astar2.next(pred, heuristic)) {
@@ -0,0 +1,220 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#include "ScriptProfiler.h"
+#include "gameset/gameset.h"
+#include "gameset/values.h"
+#include "gameset/finder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#ifndef WKBRE2_HEADLESS
+#include "imgui/imgui.h"
+#endif
+
+std::atomic_bool ScriptProfiler::s_enabled{ false };
+
+namespace {
+	thread_local ScriptProfiler::Scope* t_currentScope = nullptr;
+
+	uint64_t GetNanoseconds() {
+		using namespace std::chrono;
+		return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	struct ProfiledValueDeterminer : ValueDeterminer {
+		std::unique_ptr<ValueDeterminer> original;
+		ScriptProfileEntry* entry;
+		ProfiledValueDeterminer(ValueDeterminer* original, ScriptProfileEntry* entry) : original(original), entry(entry) {}
+		virtual float eval(ScriptContext* ctx) override {
+			ScriptProfiler::Scope _(entry);
+			return original->eval(ctx);
+		}
+		virtual void parse(GSFileParser& gsf, const GameSet& gs) override { original->parse(gsf, gs); }
+	};
+
+	struct ProfiledObjectFinder : ObjectFinder {
+		std::unique_ptr<ObjectFinder> original;
+		ScriptProfileEntry* entry;
+		ProfiledObjectFinder(ObjectFinder* original, ScriptProfileEntry* entry) : original(original), entry(entry) {}
+		virtual ObjectFinderResult eval(ScriptContext* ctx) override {
+			ScriptProfiler::Scope _(entry);
+			return original->eval(ctx);
+		}
+		virtual CommonGameObject* findNearest(ScriptContext* ctx, const Vector3& center, const NearestPredicate& pred) override {
+			ScriptProfiler::Scope _(entry);
+			return original->findNearest(ctx, center, pred);
+		}
+		virtual void parse(GSFileParser& gsf, const GameSet& gs) override { original->parse(gsf, gs); }
+	};
+
+	const char* const kindNames[ScriptProfileEntry::NUM_KINDS] = { "Action sequence", "Equation", "Object finder", "Reaction" };
+}
+
+ScriptProfiler& ScriptProfiler::instance()
+{
+	static ScriptProfiler profiler;
+	return profiler;
+}
+
+void ScriptProfiler::Scope::enter()
+{
+	m_parent = t_currentScope;
+	t_currentScope = this;
+	m_start = GetNanoseconds();
+}
+
+void ScriptProfiler::Scope::leave()
+{
+	const uint64_t elapsed = GetNanoseconds() - m_start;
+	m_entry->calls.fetch_add(1, std::memory_order_relaxed);
+	m_entry->totalTime.fetch_add(elapsed, std::memory_order_relaxed);
+	m_entry->selfTime.fetch_add(elapsed - std::min(elapsed, m_childTime), std::memory_order_relaxed);
+	if (m_parent)
+		m_parent->m_childTime += elapsed;
+	t_currentScope = m_parent;
+}
+
+ScriptProfileEntry* ScriptProfiler::addEntry(ScriptProfileEntry::Kind kind, std::string name)
+{
+	auto lock = std::lock_guard<std::mutex>(m_entriesMutex);
+	return &m_entries.emplace_back(kind, std::move(name));
+}
+
+void ScriptProfiler::instrumentGameSet(GameSet& gameSet)
+{
+	// the entries of the previous gameset are not used anymore
+	{
+		auto lock = std::lock_guard<std::mutex>(m_entriesMutex);
+		m_entries.clear();
+	}
+	for (size_t i = 0; i < gameSet.actionSequences.size(); i++) {
+		ActionSequence& seq = gameSet.actionSequences[i];
+		if (seq.debugInfo)
+			seq.debugInfo->profileEntry = addEntry(ScriptProfileEntry::ACTION_SEQUENCE, gameSet.actionSequences.getString((int)i));
+	}
+	for (size_t i = 0; i < gameSet.reactions.size(); i++)
+		gameSet.reactions[i].profileEntry = addEntry(ScriptProfileEntry::REACTION, gameSet.reactions.getString((int)i));
+
+	// The wrappers add a virtual call to every evaluation, so only put them if asked for
+	if (!isEnabled())
+		return;
+	for (size_t i = 0; i < gameSet.equations.size(); i++) {
+		if (ValueDeterminer*& equ = gameSet.equations[i])
+			equ = new ProfiledValueDeterminer(equ, addEntry(ScriptProfileEntry::EQUATION, gameSet.equations.getString((int)i)));
+	}
+	for (size_t i = 0; i < gameSet.objectFinderDefinitions.size(); i++) {
+		if (ObjectFinder*& finder = gameSet.objectFinderDefinitions[i])
+			finder = new ProfiledObjectFinder(finder, addEntry(ScriptProfileEntry::OBJECT_FINDER, gameSet.objectFinderDefinitions.getString((int)i)));
+	}
+}
+
+void ScriptProfiler::resetCounters()
+{
+	auto lock = std::lock_guard<std::mutex>(m_entriesMutex);
+	for (ScriptProfileEntry& entry : m_entries) {
+		entry.calls = 0;
+		entry.totalTime = 0;
+		entry.selfTime = 0;
+	}
+}
+
+bool ScriptProfiler::dumpCsv(const char* filename)
+{
+	FILE* file = fopen(filename, "w");
+	if (!file)
+		return false;
+	auto lock = std::lock_guard<std::mutex>(m_entriesMutex);
+	fprintf(file, "Kind,Name,Calls,Total ms,Self ms,Average us\n");
+	for (const ScriptProfileEntry& entry : m_entries) {
+		const uint64_t calls = entry.calls;
+		if (calls == 0)
+			continue;
+		std::string name = entry.name;
+		for (size_t pos = name.find('"'); pos != std::string::npos; pos = name.find('"', pos + 2))
+			name.insert(pos, 1, '"');
+		fprintf(file, "%s,\"%s\",%llu,%.3f,%.3f,%.3f\n", kindNames[entry.kind], name.c_str(), (unsigned long long)calls,
+			entry.totalTime / 1e6, entry.selfTime / 1e6, entry.totalTime / 1e3 / calls);
+	}
+	fclose(file);
+	return true;
+}
+
+#ifndef WKBRE2_HEADLESS
+void ScriptProfiler::imgui()
+{
+	struct Row {
+		const ScriptProfileEntry* entry;
+		uint64_t calls, totalTime, selfTime;
+	};
+	static char filename[256] = "script_profile.csv";
+	static bool dumpFailed = false;
+	static int kindFilter = -1;
+
+	ImGui::Begin("Script Profiler");
+	bool enabled = isEnabled();
+	if (ImGui::Checkbox("Enabled", &enabled))
+		setEnabled(enabled);
+	ImGui::SameLine();
+	if (ImGui::Button("Reset"))
+		resetCounters();
+	ImGui::InputText("File", filename, sizeof(filename));
+	ImGui::SameLine();
+	if (ImGui::Button("Dump CSV"))
+		dumpFailed = !dumpCsv(filename);
+	if (dumpFailed)
+		ImGui::TextColored(ImVec4(1, 0, 0, 1), "Could not write the file");
+	ImGui::RadioButton("All", &kindFilter, -1);
+	for (int k = 0; k < ScriptProfileEntry::NUM_KINDS; k++) {
+		ImGui::SameLine();
+		ImGui::RadioButton(kindNames[k], &kindFilter, k);
+	}
+
+	std::vector<Row> rows;
+	{
+		auto lock = std::lock_guard<std::mutex>(m_entriesMutex);
+		for (const ScriptProfileEntry& entry : m_entries)
+			if (entry.calls != 0 && (kindFilter == -1 || entry.kind == kindFilter))
+				rows.push_back({ &entry, entry.calls, entry.totalTime, entry.selfTime });
+	}
+
+	if (ImGui::BeginTable("ScriptProfileTable", 5, ImGuiTableFlags_Sortable | ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable)) {
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_NoSort);
+		ImGui::TableSetupColumn("Calls");
+		ImGui::TableSetupColumn("Total ms");
+		ImGui::TableSetupColumn("Self ms", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+		ImGui::TableSetupColumn("Avg us");
+		ImGui::TableHeadersRow();
+
+		int sortColumn = 3; bool ascending = false;
+		if (const ImGuiTableSortSpecs* specs = ImGui::TableGetSortSpecs(); specs && specs->SpecsCount > 0) {
+			sortColumn = specs->Specs[0].ColumnIndex;
+			ascending = specs->Specs[0].SortDirection == ImGuiSortDirection_Ascending;
+		}
+		const auto key = [sortColumn](const Row& row) -> double {
+			switch (sortColumn) {
+			case 1: return (double)row.calls;
+			case 2: return (double)row.totalTime;
+			case 4: return (double)row.totalTime / row.calls;
+			default: return (double)row.selfTime;
+			}
+		};
+		std::sort(rows.begin(), rows.end(), [&](const Row& a, const Row& b) { return ascending ? key(a) < key(b) : key(a) > key(b); });
+
+		for (const Row& row : rows) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::Text("%s: %s", kindNames[row.entry->kind], row.entry->name.c_str());
+			ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)row.calls);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", row.totalTime / 1e6);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", row.selfTime / 1e6);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", row.totalTime / 1e3 / row.calls);
+		}
+		ImGui::EndTable();
+	}
+	ImGui::End();
+}
+#endif
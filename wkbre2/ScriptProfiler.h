@@ -0,0 +1,72 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+struct GameSet;
+
+// Call count and time spent in one gameset definition (action sequence, equation, finder or reaction)
+struct ScriptProfileEntry {
+	enum Kind { ACTION_SEQUENCE = 0, EQUATION, OBJECT_FINDER, REACTION, NUM_KINDS };
+	Kind kind;
+	std::string name;
+	std::atomic<uint64_t> calls{ 0 };
+	std::atomic<uint64_t> totalTime{ 0 }; // nanoseconds, including the definitions called from this one
+	std::atomic<uint64_t> selfTime{ 0 };  // nanoseconds, excluding the definitions called from this one
+
+	ScriptProfileEntry(Kind kind, std::string name) : kind(kind), name(std::move(name)) {}
+};
+
+// Measures where the script time goes, per gameset definition.
+// Action sequences and reactions are always instrumented but only record when enabled,
+// equations and object finder definitions must be wrapped with instrumentGameSet
+// when the gameset is loaded (see "scriptProfiler" in wkconfig.json).
+class ScriptProfiler
+{
+public:
+	static ScriptProfiler& instance();
+
+	// Measures the time until the end of the scope, does nothing if entry is null or profiling disabled
+	class Scope {
+	public:
+		Scope(ScriptProfileEntry* entry) : m_entry(isEnabled() ? entry : nullptr) { if (m_entry) enter(); }
+		~Scope() { if (m_entry) leave(); }
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	private:
+		ScriptProfileEntry* m_entry;
+		Scope* m_parent;
+		uint64_t m_start;
+		uint64_t m_childTime = 0;
+		void enter();
+		void leave();
+	};
+
+	static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+	static void setEnabled(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+
+	ScriptProfileEntry* addEntry(ScriptProfileEntry::Kind kind, std::string name);
+
+	// Replaces the equations and object finder definitions of the gameset by profiled wrappers,
+	// and creates the entries for the named action sequences and reactions.
+	// The entries of the previously instrumented gameset are deleted, so it must not be run anymore.
+	void instrumentGameSet(GameSet& gameSet);
+
+	void resetCounters();
+	bool dumpCsv(const char* filename);
+	void imgui();
+
+private:
+	ScriptProfiler() = default;
+	std::mutex m_entriesMutex;
+	std::deque<ScriptProfileEntry> m_entries; // deque so that the entry pointers stay valid
+
+	static std::atomic_bool s_enabled;
+};
@@ -0,0 +1,121 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#include "TickProfiler.h"
+#include "settings.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cstdio>
+#ifndef WKBRE2_HEADLESS
+#include "imgui/imgui.h"
+#endif
+
+TickProfiler::Zone::Zone(TickProfiler& profiler, const char* name) : profiler(profiler), name(name)
+{
+	start = profiler.now();
+	previousCursor = profiler.cursor;
+	profiler.cursor = start;
+}
+
+TickProfiler::Zone::~Zone()
+{
+	if (profiler.enabled) {
+		uint64_t end = profiler.now();
+		profiler.tickEvents.push_back({ name, start, (uint32_t)(end - start), 1, profiler.numTicks });
+	}
+	profiler.cursor = previousCursor;
+}
+
+TickProfiler::TickProfiler()
+{
+	startTime = std::chrono::steady_clock::now();
+#ifdef WKBRE2_TICK_PROFILER
+	// without the profiler, no event is ever recorded, so don't waste memory on the ring buffer
+	size_t capacity = 65536;
+	if (g_settings.is_object())
+		capacity = g_settings.value<size_t>("tickProfilerBufferSize", capacity);
+	ring.resize(std::max<size_t>(capacity, 1));
+#endif
+}
+
+uint64_t TickProfiler::now() const
+{
+	using namespace std::chrono;
+	return (uint64_t)duration_cast<microseconds>(steady_clock::now() - startTime).count();
+}
+
+void TickProfiler::addAccumulated(const char* name, uint64_t total, uint32_t count)
+{
+	if (!enabled || count == 0)
+		return;
+	// The time of an accumulated zone is spread over the whole enclosing zone,
+	// so the accumulated events are placed one after the other from the start of the enclosing zone.
+	tickEvents.push_back({ name, cursor, (uint32_t)total, count, numTicks });
+	cursor += total;
+}
+
+void TickProfiler::endTick()
+{
+	if (!tickEvents.empty()) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const Event& ev : tickEvents) {
+			ring[ringNext] = ev;
+			if (++ringNext == ring.size()) {
+				ringNext = 0;
+				ringFull = true;
+			}
+		}
+		lastTick = tickEvents;
+	}
+	tickEvents.clear();
+	numTicks++;
+}
+
+std::vector<TickProfiler::Event> TickProfiler::getLastTick()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return lastTick;
+}
+
+bool TickProfiler::dumpChromeTrace(const char* filename)
+{
+	FILE* file = fopen(filename, "w");
+	if (!file)
+		return false;
+	std::lock_guard<std::mutex> lock(mutex);
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	size_t first = ringFull ? ringNext : 0;
+	size_t numEvents = ringFull ? ring.size() : ringNext;
+	for (size_t i = 0; i < numEvents; i++) {
+		const Event& ev = ring[(first + i) % ring.size()];
+		fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"tick\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%llu,\"dur\":%u,\"args\":{\"tick\":%llu,\"count\":%u}}\n",
+			(i != 0) ? "," : "", ev.name, (unsigned long long)ev.start, ev.duration, (unsigned long long)ev.tick, ev.count);
+	}
+	fprintf(file, "]}\n");
+	fclose(file);
+	return true;
+}
+
+#ifndef WKBRE2_HEADLESS
+void TickProfiler::imgui()
+{
+	ImGui::Begin("Tick Profiler");
+#ifdef WKBRE2_TICK_PROFILER
+	static char filename[256] = "tick_trace.json";
+	static bool dumpFailed = false;
+	ImGui::Checkbox("Enabled", &enabled);
+	ImGui::InputText("File", filename, sizeof(filename));
+	if (ImGui::Button("Dump Chrome trace"))
+		dumpFailed = !dumpChromeTrace(filename);
+	if (dumpFailed)
+		ImGui::TextColored(ImVec4(1, 0, 0, 1), "Could not write the file");
+	ImGui::Separator();
+	for (const Event& ev : getLastTick())
+		ImGui::Text("%-24s %8.3f ms  x%u", ev.name, ev.duration / 1000.0f, ev.count);
+#else
+	ImGui::TextUnformatted("Compiled without WKBRE2_TICK_PROFILER.");
+#endif
+	ImGui::End();
+}
+#endif
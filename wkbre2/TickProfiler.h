@@ -0,0 +1,100 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Records how long every phase of a server tick takes.
+// The events of the last ticks are kept in a ring buffer, which can be dumped
+// as a Chrome trace_event JSON file (open it in chrome://tracing or ui.perfetto.dev).
+// The zone macros only do something if the program is built with WKBRE2_TICK_PROFILER.
+struct TickProfiler {
+	struct Event {
+		const char* name; // must be a string literal
+		uint64_t start;   // microseconds since the profiler was created
+		uint32_t duration; // microseconds
+		uint32_t count;   // number of times the zone was entered during the tick
+		uint64_t tick;
+	};
+
+	// Measures the time between its construction and destruction
+	struct Zone {
+		TickProfiler& profiler;
+		const char* name;
+		uint64_t start;
+		uint64_t previousCursor;
+		Zone(TickProfiler& profiler, const char* name);
+		~Zone();
+	};
+
+	// Sums the time of a zone entered many times in a tick (e.g. once per object),
+	// reported as a single event when the accumulator is destroyed
+	struct Accumulator {
+		TickProfiler& profiler;
+		const char* name;
+		uint64_t total = 0;
+		uint32_t count = 0;
+		Accumulator(TickProfiler& profiler, const char* name) : profiler(profiler), name(name) {}
+		~Accumulator() { profiler.addAccumulated(name, total, count); }
+	};
+
+	struct AccumulatorZone {
+		Accumulator& acc;
+		uint64_t start;
+		AccumulatorZone(Accumulator& acc) : acc(acc), start(acc.profiler.now()) {}
+		~AccumulatorZone() { acc.total += acc.profiler.now() - start; acc.count++; }
+	};
+
+	bool enabled = true;
+
+	TickProfiler();
+
+	uint64_t now() const;
+
+	// Called at the end of a tick, moves the events of the tick into the ring buffer
+	void endTick();
+
+	// Returns the events of the last completed tick
+	std::vector<Event> getLastTick();
+
+	// Writes all events of the ring buffer as Chrome trace_event JSON. Returns false if the file couldn't be opened.
+	bool dumpChromeTrace(const char* filename);
+
+	void imgui();
+
+private:
+	std::chrono::steady_clock::time_point startTime;
+	uint64_t numTicks = 0;
+	uint64_t cursor = 0; // where the next accumulated event will be placed in the timeline
+	std::vector<Event> tickEvents; // events of the current tick, only touched by the server thread
+
+	std::mutex mutex; // protects the members below
+	std::vector<Event> ring; // empty if built without WKBRE2_TICK_PROFILER
+	size_t ringNext = 0;
+	bool ringFull = false;
+	std::vector<Event> lastTick;
+
+	void addAccumulated(const char* name, uint64_t total, uint32_t count);
+};
+
+#ifdef WKBRE2_TICK_PROFILER
+#define TICKPROF_CONCAT2(a, b) a##b
+#define TICKPROF_CONCAT(a, b) TICKPROF_CONCAT2(a, b)
+// Measures the time until the end of the current scope
+#define TICKPROF_ZONE(profiler, name) TickProfiler::Zone TICKPROF_CONCAT(_tickProfZone, __LINE__)((profiler), (name))
+// Declares an accumulator, reported when the current scope ends
+#define TICKPROF_ACCUMULATOR(profiler, var, name) TickProfiler::Accumulator var((profiler), (name))
+// Adds the time until the end of the current scope to the accumulator
+#define TICKPROF_ACCUMULATE(var) TickProfiler::AccumulatorZone TICKPROF_CONCAT(_tickProfAcc, __LINE__)(var)
+#define TICKPROF_END_TICK(profiler) (profiler).endTick()
+#else
+#define TICKPROF_ZONE(profiler, name) ((void)0)
+#define TICKPROF_ACCUMULATOR(profiler, var, name) ((void)0)
+#define TICKPROF_ACCUMULATE(var) ((void)0)
+#define TICKPROF_END_TICK(profiler) ((void)0)
+#endif
@@ -4,15 +4,41 @@
 
 #include "TimeManager.h"
 #include "util/GSFileParser.h"
-#include <SDL2/SDL_timer.h>
+#include "settings.h"
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <cmath>
+#include <string>
+#ifndef WKBRE2_HEADLESS
 #include "imgui/imgui.h"
+#endif
+
+static uint32_t GetWallTicks() {
+	using namespace std::chrono;
+	return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+TimeManager::TimeManager() {
+	// Clock mode selected in wkconfig.json: "clockMode" is "realtime", "fixed" or "fast"
+	if (g_settings.is_object()) {
+		std::string mode = g_settings.value<std::string>("clockMode", "realtime");
+		uint32_t rate = g_settings.value<uint32_t>("clockTickRate", 60);
+		if (mode == "fixed")
+			setClockMode(ClockMode::FIXED_STEP, rate);
+		else if (mode == "fast")
+			setClockMode(ClockMode::FAST_FORWARD, rate);
+	}
+	previousSDLTime = GetWallTicks();
+}
 
 void TimeManager::reset(game_time_t initialTime) {
 	psCurrentTime = (uint32_t)(initialTime * 1000.0f);
+	usCurrentTime = (uint64_t)psCurrentTime * 1000;
 	currentTime = previousTime = psCurrentTime / 1000.0f; elapsedTime = 0;
 	timeSpeed = 1.0f;
 	paused = true; lockCount = 1;
-	previousSDLTime = SDL_GetTicks();
+	numTicks = 0;
+	previousSDLTime = GetWallTicks();
 }
 
 void TimeManager::load(GSFileParser &gsf) {
@@ -22,6 +48,9 @@ void TimeManager::load(GSFileParser &gsf) {
 		if (tag == "CURRENT_TIME") {
 			currentTime = gsf.nextFloat();
 			psCurrentTime = (uint32_t)(currentTime * 1000.0f);
+			usCurrentTime = (uint64_t)psCurrentTime * 1000;
+			// the tick count isn't saved, take the number of fixed steps that give the current time
+			numTicks = (usCurrentTime * tickRate + 500000) / 1000000;
 		}
 		else if (tag == "PREVIOUS_TIME")
 			previousTime = gsf.nextFloat();
@@ -37,26 +66,62 @@ void TimeManager::load(GSFileParser &gsf) {
 	}
 }
 
+void TimeManager::setClockMode(ClockMode mode, uint32_t rate) {
+	clockMode = mode;
+	tickRate = (rate > 0) ? rate : 60;
+}
+
+void TimeManager::setCurrentTime(uint32_t msTime) {
+	psCurrentTime = msTime;
+	usCurrentTime = (uint64_t)msTime * 1000;
+	currentTime = (float)psCurrentTime / 1000.0f;
+}
+
+void TimeManager::advance(uint64_t usElapsedTime) {
+	previousTime = currentTime;
+	usCurrentTime += usElapsedTime;
+	psCurrentTime = (uint32_t)(usCurrentTime / 1000);
+	currentTime = (float)psCurrentTime / 1000.0f;
+	elapsedTime = currentTime - previousTime;
+	numTicks += 1;
+}
+
 void TimeManager::tick() {
-	uint32_t nextSDLTime = SDL_GetTicks();
+	uint32_t nextSDLTime = GetWallTicks();
 	uint32_t elapsedSDLTime = nextSDLTime - previousSDLTime;
 	previousSDLTime = nextSDLTime;
+	if (isFixedStep()) {
+		step(1);
+		return;
+	}
 	if (paused) return;
 	if (elapsedSDLTime >= 1000)
 		elapsedSDLTime = 34;
-	previousTime = currentTime;
-	psCurrentTime += (uint32_t)roundf(elapsedSDLTime * timeSpeed);
-	currentTime = (float)psCurrentTime / 1000.0f;
-	elapsedTime = currentTime - previousTime;
+	advance((uint64_t)std::llround(elapsedSDLTime * timeSpeed) * 1000);
 }
 
+void TimeManager::step(uint32_t numSteps) {
+	if (paused) return;
+	const uint64_t usStep = (uint64_t)std::llround(1000000.0 * timeSpeed / tickRate);
+	advance(usStep * numSteps);
+}
+
+#ifndef WKBRE2_HEADLESS
 void TimeManager::imgui() {
+	static const char* const modeNames[] = { "Real time", "Fixed step", "Fast forward" };
 	ImGui::Begin("Time Manager");
 	ImGui::Value("Current time", currentTime);
 	ImGui::Value("Previous time", previousTime);
 	ImGui::Value("Elapsed time", elapsedTime);
+	ImGui::Text("Ticks: %llu", (unsigned long long)numTicks);
+	int mode = (int)clockMode;
+	if (ImGui::Combo("Clock mode", &mode, modeNames, 3))
+		setClockMode((ClockMode)mode, tickRate);
+	ImGui::InputScalar("Tick rate", ImGuiDataType_U32, &tickRate);
+	if (tickRate == 0) tickRate = 1;
 	ImGui::DragFloat("Speed", &timeSpeed);
 	ImGui::InputScalar("Lock count", ImGuiDataType_U32, &lockCount);
 	ImGui::Checkbox("Paused", &paused);
 	ImGui::End();
-}
\ No newline at end of file
+}
+#endif
@@ -11,15 +11,28 @@ typedef float game_time_t;
 struct GSFileParser;
 
 struct TimeManager {
+	enum class ClockMode {
+		REALTIME = 0, // time follows the wall clock
+		FIXED_STEP,   // every tick advances the time by a fixed step, the caller paces the ticks
+		FAST_FORWARD, // fixed step, but the caller ticks as fast as possible
+	};
+
 	// float is baaad!!
 	uint32_t psCurrentTime = 0;
 	game_time_t currentTime = 0.0f, previousTime = 0.0f, elapsedTime = 0.0f, timeSpeed = 1.0f;
 	bool paused = true; uint32_t lockCount = 1;
+
+	ClockMode clockMode = ClockMode::REALTIME;
+	uint32_t tickRate = 60; // number of fixed steps per second of game time
+	uint64_t numTicks = 0; // number of times the time advanced, derived from the time when loading a savegame
+	uint64_t usCurrentTime = 0; // current time in microseconds, so fixed steps don't accumulate rounding errors
 	
-	uint32_t previousSDLTime;
+	uint32_t previousSDLTime = 0;
 
 	// synch to clients ...
 
+	TimeManager();
+
 	void reset(game_time_t initialTime);
 	void load(GSFileParser &gsf);
 
@@ -30,8 +43,18 @@ struct TimeManager {
 	void unpause() { paused = false; }
 
 	void setSpeed(float nextSpeed) { timeSpeed = nextSpeed; }
+	void setClockMode(ClockMode mode, uint32_t rate = 60);
+	void setCurrentTime(uint32_t msTime);
 
+	bool isFixedStep() const { return clockMode != ClockMode::REALTIME; }
+
+	// Advances the time, depending on the clock mode
 	void tick();
+	// Advances the time by the given number of fixed steps, whatever the clock mode
+	void step(uint32_t numSteps = 1);
 
 	void imgui();
+
+private:
+	void advance(uint64_t usElapsedTime);
 };
@@ -0,0 +1,87 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#include "VisibilityGrid.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+void VisibilityGrid::init(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	players.clear();
+	everythingDiscovered = false;
+}
+
+int VisibilityGrid::findPlayerIndex(uint32_t playerId) const
+{
+	for (size_t i = 0; i < players.size(); i++)
+		if (players[i].playerId == playerId)
+			return (int)i;
+	return -1;
+}
+
+int VisibilityGrid::getPlayerIndex(uint32_t playerId)
+{
+	int index = findPlayerIndex(playerId);
+	if (index != -1)
+		return index;
+	const size_t numTiles = (size_t)(width * height);
+	PlayerGrid& grid = players.emplace_back();
+	grid.playerId = playerId;
+	grid.stampCounts.assign(numTiles, 0);
+	grid.visibleBits.assign((numTiles + 63) / 64, 0);
+	grid.discoveredBits.assign((numTiles + 63) / 64, 0);
+	return (int)players.size() - 1;
+}
+
+void VisibilityGrid::changeStamp(Stamp& current, const Stamp& updated)
+{
+	if (current == updated)
+		return;
+	applyStamp(current, -1);
+	applyStamp(updated, 1);
+	current = updated;
+}
+
+void VisibilityGrid::applyStamp(const Stamp& stamp, int delta)
+{
+	if (stamp.playerIndex < 0 || stamp.radius < 0)
+		return;
+	PlayerGrid& grid = players[stamp.playerIndex];
+	const int minZ = std::max(0, stamp.tz - stamp.radius), maxZ = std::min(height - 1, stamp.tz + stamp.radius);
+	for (int z = minZ; z <= maxZ; z++) {
+		// tiles whose center is in the circle
+		const int dz = z - stamp.tz;
+		const int halfWidth = (int)std::sqrt((float)(stamp.radius * stamp.radius - dz * dz));
+		const int minX = std::max(0, stamp.tx - halfWidth), maxX = std::min(width - 1, stamp.tx + halfWidth);
+		for (int x = minX; x <= maxX; x++) {
+			const size_t tile = (size_t)(z * width + x);
+			uint16_t& count = grid.stampCounts[tile];
+			const uint64_t bit = (uint64_t)1 << (tile & 63);
+			if (delta > 0) {
+				if (count++ == 0) {
+					grid.visibleBits[tile >> 6] |= bit;
+					grid.discoveredBits[tile >> 6] |= bit;
+				}
+			}
+			else {
+				assert(count > 0);
+				if (--count == 0)
+					grid.visibleBits[tile >> 6] &= ~bit;
+			}
+		}
+	}
+}
+
+int VisibilityGrid::CountTrailingZeros(uint64_t word)
+{
+	int n = 0;
+	while (!(word & 1)) {
+		word >>= 1;
+		n++;
+	}
+	return n;
+}
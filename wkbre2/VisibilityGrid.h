@@ -0,0 +1,77 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Tiles seen and discovered by every player.
+// Every object that sees adds a stamp to the tiles of its sight circle for its player,
+// and the stamp is removed when the object moves to another tile, changes sight range,
+// changes player or disappears. A tile is visible while at least one stamp covers it,
+// and discovered once it has been visible, so the queries are just bit lookups.
+class VisibilityGrid
+{
+public:
+	// What an object adds to the grid
+	struct Stamp {
+		int playerIndex = -1; // -1 if nothing added
+		int tx = 0, tz = 0;
+		int radius = 0; // in tiles
+		bool operator==(const Stamp& other) const { return playerIndex == other.playerIndex && tx == other.tx && tz == other.tz && radius == other.radius; }
+		bool operator!=(const Stamp& other) const { return !(*this == other); }
+	};
+
+	void init(int width, int height);
+	// The discovered tiles are not in the savegames, so when a match in progress is loaded,
+	// the tiles discovered before can't be known and every tile is considered discovered
+	void setEverythingDiscovered(bool value) { everythingDiscovered = value; }
+	bool isEverythingDiscovered() const { return everythingDiscovered; }
+
+	// Index used in the stamps for the player object with the given ID, added if needed
+	int getPlayerIndex(uint32_t playerId);
+	// Index of the player, or -1 if the player never had anything on the grid
+	int findPlayerIndex(uint32_t playerId) const;
+
+	// Replaces the stamp of an object by a new one
+	void changeStamp(Stamp& current, const Stamp& updated);
+
+	bool isVisible(int playerIndex, int tx, int tz) const { return getBit(playerIndex, tx, tz, &PlayerGrid::visibleBits); }
+	bool isDiscovered(int playerIndex, int tx, int tz) const { return everythingDiscovered || getBit(playerIndex, tx, tz, &PlayerGrid::discoveredBits); }
+	// Calls func(tileIndex) for every tile discovered by the player
+	template <typename Func> void forEachDiscoveredTile(int playerIndex, Func func) const {
+		if (everythingDiscovered) {
+			for (int tile = 0; tile < width * height; tile++)
+				func(tile);
+			return;
+		}
+		if (playerIndex < 0 || (size_t)playerIndex >= players.size())
+			return;
+		const std::vector<uint64_t>& bits = players[playerIndex].discoveredBits;
+		for (size_t w = 0; w < bits.size(); w++)
+			for (uint64_t word = bits[w]; word; word &= word - 1)
+				func((int)(w * 64 + CountTrailingZeros(word)));
+	}
+
+private:
+	struct PlayerGrid {
+		uint32_t playerId;
+		std::vector<uint16_t> stampCounts; // number of stamps on every tile
+		std::vector<uint64_t> visibleBits, discoveredBits;
+	};
+	int width = 0, height = 0;
+	std::vector<PlayerGrid> players;
+	bool everythingDiscovered = false;
+
+	bool getBit(int playerIndex, int tx, int tz, std::vector<uint64_t> PlayerGrid::* bits) const {
+		if (playerIndex < 0 || (size_t)playerIndex >= players.size() || tx < 0 || tx >= width || tz < 0 || tz >= height)
+			return false;
+		const size_t tile = (size_t)(tz * width + tx);
+		return ((players[playerIndex].*bits)[tile >> 6] >> (tile & 63)) & 1;
+	}
+	void applyStamp(const Stamp& stamp, int delta);
+	static int CountTrailingZeros(uint64_t word);
+};
@@ -177,7 +177,7 @@ void Client::tick()
 				auto* obj = findObject(objid);
 				if (!obj) printf("CLI-WARN: Obj %i from message does not exist\n", objid);
 				if (obj)
-					obj->items[index] = value;
+					obj->storeItem(index, value);
 				break;
 			}
 			case NETCLIMSG_OBJECT_PARENT_SET: {
@@ -192,6 +192,7 @@ void Client::tick()
 				obj->parent = newParent;
 				if (newParent)
 					newParent->children[obj->blueprint].push_back(obj);
+				updateSubtreeRegistration(obj);
 				break;
 			}
 			case NETCLIMSG_TERRAIN_SET: {
@@ -200,8 +201,7 @@ void Client::tick()
 				terrain->readFromFile(mapfp.c_str());
 				if (cliInterface)
 					cliInterface->updateTerrain();
-				auto area = this->terrain->getNumPlayableTiles();
-				this->tiles = std::make_unique<Tile[]>(area.first * area.second);
+				initTiles();
 				break;
 			}
 			case NETCLIMSG_OBJECT_POSITION_SET: {
@@ -242,8 +242,7 @@ void Client::tick()
 				break;
 			}
 			case NETCLIMSG_TIME_SYNC: {
-				timeManager.psCurrentTime = br.readUint32();
-				timeManager.currentTime = (float)timeManager.psCurrentTime / 1000.0f;
+				timeManager.setCurrentTime(br.readUint32());
 				timeManager.paused = br.readUint8();
 				break;
 			}
@@ -282,10 +281,17 @@ void Client::tick()
 					// remove from parent's children
 					auto &vec = obj->parent->children.at(obj->blueprint);
 					vec.erase(std::find(vec.begin(), vec.end(), obj));
+					// remove from its tile
+					if (obj->tileIndex != -1)
+						moveToTile(obj, -1);
+					// remove its footprint
+					freeOccupiedTiles(obj);
+					// remove from the lists of its player
+					unregister(obj);
 					// remove from ID map
 					idmap.erase(obj->id);
 					// delete the object, bye!
-					delete obj;
+					objectPool.destroy(obj);
 				}
 				break;
 			}
@@ -300,7 +306,9 @@ void Client::tick()
 					// add it back at the correct blueprint key
 					obj->parent->children[postbp].push_back(obj);
 					// now converted!
-					obj->blueprint = postbp;
+					obj->changeBlueprint(postbp);
+					updateRegistration(obj);
+					updateTileClass(obj);
 				}
 				break;
 			}
@@ -310,8 +318,7 @@ void Client::tick()
 				uint8_t status = br.readUint8();
 				ClientGameObject *a = findObject(id1), *b = findObject(id2);
 				if (a && b) {
-					int &ref = (a->id <= b->id) ? diplomaticStatuses[{ a->id, b->id }] : diplomaticStatuses[{ b->id, a->id }];
-					ref = status;
+					storeDiplomaticStatus(a, b, status);
 				}
 				break;
 			}
@@ -411,7 +418,7 @@ void Client::tick()
 				if (ClientGameObject* from = findObject(objid)) {
 					if (ClientGameObject* to = findObject(targetid)) {
 						std::string path; float refDist, maxDist;
-						std::tie(path, refDist, maxDist) = from->blueprint->getSound(soundTag, from->subtype);
+						std::tie(path, refDist, maxDist) = from->blueprint->getSound(soundTag, from->subtype, cosmeticRandom);
 						if (!path.empty()) {
 							std::string gfspath = "Warrior Kings Game Set\\Sounds\\" + path;
 							if (to->blueprint->bpClass == Tags::GAMEOBJCLASS_PLAYER)
@@ -430,7 +437,7 @@ void Client::tick()
 				br.readTo(objid, soundTag, targetPos, randval);
 				if (ClientGameObject* from = findObject(objid)) {
 					std::string path; float refDist, maxDist;
-					std::tie(path, refDist, maxDist) = from->blueprint->getSound(soundTag, from->subtype);
+					std::tie(path, refDist, maxDist) = from->blueprint->getSound(soundTag, from->subtype, cosmeticRandom);
 					if (!path.empty()) {
 						std::string gfspath = "Warrior Kings Game Set\\Sounds\\" + path;
 						SoundPlayer::getSoundPlayer()->playSound3D(gfspath, targetPos, refDist, maxDist);
@@ -444,7 +451,7 @@ void Client::tick()
 				if (ClientGameObject* player = clientPlayer) {
 					auto it = player->blueprint->musicMap.find(musicTag);
 					if (it != player->blueprint->musicMap.end()) {
-						size_t var = (size_t)rand() % it->second.size();
+						size_t var = cosmeticRandom.nextInt(it->second.size());
 						SoundPlayer::getSoundPlayer()->playMusic("Warrior Kings Game Set\\Sounds\\" + it->second[var]);
 						isMusicPlaying = true;
 					}
@@ -455,7 +462,7 @@ void Client::tick()
 				uint32_t objid; int sfxTag; Vector3 pos;
 				br.readTo(objid, sfxTag, pos);
 				if (auto* obj = findObject(objid)) {
-					if (Model* sfxmodel = obj->blueprint->getSpecialEffect(sfxTag)) {
+					if (Model* sfxmodel = obj->blueprint->getSpecialEffect(sfxTag, cosmeticRandom)) {
 						specialEffects.emplace_back();
 						auto& sfx = specialEffects.back();
 						sfx.entity.transform = Matrix::getTranslationMatrix(pos);
@@ -470,7 +477,7 @@ void Client::tick()
 				uint32_t objid; int sfxTag; Vector3 pos1, pos2;
 				br.readTo(objid, sfxTag, pos1, pos2);
 				if (auto* obj = findObject(objid)) {
-					if (Model* sfxmodel = obj->blueprint->getSpecialEffect(sfxTag)) {
+					if (Model* sfxmodel = obj->blueprint->getSpecialEffect(sfxTag, cosmeticRandom)) {
 						Vector3 dir = pos2 - pos1;
 						float dist = dir.len3();
 						float ang = std::atan2(dir.x, -dir.z);
@@ -490,7 +497,7 @@ void Client::tick()
 				br.readTo(objid, sfxTag, targetid);
 				if (auto* obj = findObject(objid)) {
 					if (auto* target = findObject(targetid)) {
-						if (Model* sfxmodel = obj->blueprint->getSpecialEffect(sfxTag)) {
+						if (Model* sfxmodel = obj->blueprint->getSpecialEffect(sfxTag, cosmeticRandom)) {
 							specialEffects.emplace_back();
 							auto& sfx = specialEffects.back();
 							sfx.entity.model = sfxmodel;
@@ -519,7 +526,7 @@ void Client::tick()
 				uint32_t objid; int sfxTag; Vector3 pos;
 				br.readTo(objid, sfxTag, pos);
 				if (ClientGameObject* obj = findObject(objid)) {
-					if (Model* sfxmodel = obj->blueprint->getSpecialEffect(sfxTag)) {
+					if (Model* sfxmodel = obj->blueprint->getSpecialEffect(sfxTag, cosmeticRandom)) {
 						std::pair<std::pair<CliGORef, int>, SceneEntity> p;
 						p.first = { objid, sfxTag };
 						p.second.transform = Matrix::getTranslationMatrix(pos);
@@ -736,9 +743,9 @@ void Client::sendSetBuildingSpawnedUnitOrderToDestination(ClientGameObject* obj,
 
 ClientGameObject * Client::createObject(const GameObjBlueprint * blueprint, uint32_t id)
 {
-	ClientGameObject *obj = new ClientGameObject(id, blueprint);
-	assert(idmap[id] == nullptr);
-	idmap[id] = obj;
+	ClientGameObject *obj = objectPool.create(id, blueprint);
+	[[maybe_unused]] bool inserted = idmap.insert(id, obj);
+	assert(inserted);
 	return obj;
 }
 
@@ -758,15 +765,7 @@ void ClientGameObject::updatePosition(const Vector3& newposition)
 		else
 			newtileIndex = -1;
 		if (newtileIndex != tileIndex) {
-			int prevtileIndex = tileIndex;
-			tileIndex = newtileIndex;
-			if (prevtileIndex != -1) {
-				auto& vec = prog->tiles[prevtileIndex].objList;
-				vec.erase(std::find(vec.begin(), vec.end(), this->id));
-			}
-			if (newtileIndex != -1) {
-				prog->tiles[newtileIndex].objList.push_back(this->id);
-			}
+			prog->moveToTile(this, newtileIndex);
 			updateOccupiedTiles(oldposition, orientation, newposition, orientation);
 		}
 	}
@@ -15,6 +15,7 @@
 #include <cstdarg>
 #include "TimeManager.h"
 #include "GameObjectRef.h"
+#include "util/ObjectPool.h"
 
 struct GameSet;
 struct GSFileParser;
@@ -45,6 +46,7 @@ struct Client : SpecificGameState<ClientGameObject, ProgramType::CLIENT>
 	//GameSet *gameSet;
 
 	TimeManager timeManager;
+	ObjectPool<ClientGameObject> objectPool;
 
 	//ClientGameObject *level;
 	//std::map<uint32_t, ClientGameObject*> idmap;
@@ -78,6 +80,8 @@ struct Client : SpecificGameState<ClientGameObject, ProgramType::CLIENT>
 	std::list<SpecialEffect> specialEffects;
 	std::multimap<std::pair<CliGORef, int>, SceneEntity> loopingSpecialEffects;
 
+	RandomGenerator cosmeticRandom; // for sound and effect variations, separate from the game state's generator
+
 	int dbgNumMessagesPerTick = 0, dbgNumMessagesInCurrentSec = 0, dbgNumMessagesPerSec = 0;
 	uint32_t dbgLastMessageCountTime = 0;
 
@@ -6,16 +6,47 @@
 #include "gameset/GameObjBlueprint.h"
 #include "gameset/gameset.h"
 #include "terrain.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iterator>
 
 float CommonGameObject::getItem(int item) const
 {
-	auto it = items.find(item);
-	if (it != items.end())
-		return it->second;
-	auto bt = blueprint->startItemValues.find(item);
-	if (bt != blueprint->startItemValues.end())
-		return bt->second;
-	return 0.0f;
+	const int slot = blueprint->getItemSlot(item);
+	if (slot != -1)
+		return itemValues[slot];
+	if (!overflowItems.empty()) {
+		auto it = overflowItems.find(item);
+		if (it != overflowItems.end())
+			return it->second;
+	}
+	// all the starting items are in the layout, unless there is no layout
+	return blueprint->itemSlots.empty() ? blueprint->getStartingItemValue(item) : 0.0f;
+}
+
+void CommonGameObject::storeItem(int item, float value)
+{
+	const int slot = blueprint->getItemSlot(item);
+	if (slot != -1) {
+		itemValues[slot] = value;
+		itemSlotIsSet[slot] = true;
+	}
+	else {
+		overflowItems[item] = value;
+	}
+}
+
+void CommonGameObject::changeBlueprint(const GameObjBlueprint* newBlueprint)
+{
+	std::vector<std::pair<int, float>> changedItems;
+	forEachChangedItem([&changedItems](int item, float value) { changedItems.emplace_back(item, value); });
+	blueprint = newBlueprint;
+	itemValues = newBlueprint->startSlotValues;
+	itemSlotIsSet.assign(itemValues.size(), false);
+	overflowItems.clear();
+	for (const auto& [item, value] : changedItems)
+		storeItem(item, value);
 }
 
 float CommonGameObject::getIndexedItem(int item, int index) const {
@@ -25,12 +56,11 @@ float CommonGameObject::getIndexedItem(int item, int index) const {
 	return 0.0f;
 }
 
-CommonGameObject* CommonGameObject::getPlayer() const {
-	for (const CommonGameObject* obj = this; obj; obj = obj->parent) {
-		if (obj->blueprint->bpClass == Tags::GAMEOBJCLASS_PLAYER)
-			return (CommonGameObject*)obj;
-	}
-	return nullptr;
+void CommonGameObject::updateCachedPlayer() {
+	if (blueprint->bpClass == Tags::GAMEOBJCLASS_PLAYER)
+		player = this;
+	else
+		player = parent ? parent->player : nullptr;
 }
 
 Model* CommonGameObject::getModel() const {
@@ -39,50 +69,282 @@ Model* CommonGameObject::getModel() const {
 
 int CommonGameState::getDiplomaticStatus(CommonGameObject* a, CommonGameObject* b) const {
 	if (a == b) return 0; // player is always friendly with itself :)
-	auto it = (a->id <= b->id) ? diplomaticStatuses.find({ a->id, b->id }) : diplomaticStatuses.find({ b->id, a->id });
-	if (it != diplomaticStatuses.end())
-		return it->second;
-	else
-		return gameSet->defaultDiplomaticStatus;
+	// players without a slot never had a status set
+	if (a->playerSlot != -1 && b->playerSlot != -1) {
+		int status = diplomacyMatrix[a->playerSlot * numPlayerSlots + b->playerSlot];
+		if (status != -1)
+			return status;
+	}
+	return gameSet->defaultDiplomaticStatus;
+}
+
+void CommonGameState::storeDiplomaticStatus(CommonGameObject* a, CommonGameObject* b, int status) {
+	for (CommonGameObject* player : { a, b }) {
+		if (player->playerSlot != -1)
+			continue;
+		// new row and column
+		const int newSize = numPlayerSlots + 1;
+		std::vector<int> matrix(newSize * newSize, -1);
+		for (int i = 0; i < numPlayerSlots; i++)
+			std::copy_n(diplomacyMatrix.begin() + i * numPlayerSlots, numPlayerSlots, matrix.begin() + i * newSize);
+		diplomacyMatrix = std::move(matrix);
+		player->playerSlot = numPlayerSlots++;
+	}
+	diplomacyMatrix[a->playerSlot * numPlayerSlots + b->playerSlot] = status;
+	diplomacyMatrix[b->playerSlot * numPlayerSlots + a->playerSlot] = status;
 }
 
 void CommonGameState::updateOccupiedTiles(CommonGameObject* object, const Vector3& oldposition, const Vector3& oldorientation, const Vector3& newposition, const Vector3& neworientation)
 {
 	if (!this->tiles) return;
-	int trnNumX, trnNumZ;
-	std::tie(trnNumX, trnNumZ) = this->terrain->getNumPlayableTiles();
 	if (object->blueprint->bpClass == Tags::GAMEOBJCLASS_BUILDING && object->blueprint->footprint) {
 		// free tiles from old position
-		auto rotOrigin = object->blueprint->footprint->rotateOrigin(oldorientation.y);
-		int ox = (int)((oldposition.x - rotOrigin.first) / 5.0f);
-		int oz = (int)((oldposition.z - rotOrigin.second) / 5.0f);
-		for (auto& to : object->blueprint->footprint->tiles) {
-			if (true /*!to.mode*/) {
-				auto ro = to.rotate(oldorientation.y);
-				int px = ox + ro.first, pz = oz + ro.second;
-				if (px >= 0 && px < trnNumX && pz >= 0 && pz < trnNumZ) {
-					auto& tile = this->tiles[pz * trnNumX + px];
-					if (tile.building == object->id)
-						tile.building = nullptr;
-				}
-			}
-		}
+		stampFootprint(object, oldposition, oldorientation, false);
 		// take tiles from new position
-		rotOrigin = object->blueprint->footprint->rotateOrigin(neworientation.y);
-		ox = (int)((newposition.x - rotOrigin.first) / 5.0f);
-		oz = (int)((newposition.z - rotOrigin.second) / 5.0f);
-		for (auto& to : object->blueprint->footprint->tiles) {
-			if (true /*!to.mode*/) {
-				auto ro = to.rotate(neworientation.y);
-				int px = ox + ro.first, pz = oz + ro.second;
-				if (px >= 0 && px < trnNumX && pz >= 0 && pz < trnNumZ) {
-					auto& tile = this->tiles[pz * trnNumX + px];
-					if (!tile.building.getFrom(this) || tile.buildingPassable) {
-						tile.building = object->id;
-						tile.buildingPassable = to.mode;
-					}
-				}
+		stampFootprint(object, newposition, neworientation, true);
+	}
+}
+
+void CommonGameState::freeOccupiedTiles(CommonGameObject* object)
+{
+	if (this->tiles && object->blueprint->bpClass == Tags::GAMEOBJCLASS_BUILDING && object->blueprint->footprint)
+		stampFootprint(object, object->position, object->orientation, false);
+}
+
+void CommonGameState::stampFootprint(CommonGameObject* object, const Vector3& position, const Vector3& orientation, bool take)
+{
+	auto rotOrigin = object->blueprint->footprint->rotateOrigin(orientation.y);
+	int ox = (int)((position.x - rotOrigin.first) / 5.0f);
+	int oz = (int)((position.z - rotOrigin.second) / 5.0f);
+	for (auto& to : object->blueprint->footprint->tiles) {
+		auto ro = to.rotate(orientation.y);
+		int px = ox + ro.first, pz = oz + ro.second;
+		if (px >= 0 && px < numTilesX && pz >= 0 && pz < numTilesZ) {
+			const int tileIndex = pz * numTilesX + px;
+			auto& tile = this->tiles[tileIndex];
+			if (!take) {
+				if (tile.building == object->id)
+					tile.building = nullptr;
 			}
+			else if (!tile.building.getFrom(this) || tile.buildingPassable) {
+				tile.building = object->id;
+				tile.buildingPassable = to.mode;
+			}
+			updateTileBlocked(tileIndex);
+		}
+	}
+}
+
+void CommonGameState::updateTileBlocked(int tileIndex)
+{
+	const Tile& tile = tiles[tileIndex];
+	const bool buildingBlocks = tile.building.getFrom(this) && !tile.buildingPassable;
+	bool changed = false;
+	for (int mc = 0; mc < NUM_MOVEMENT_CLASSES; mc++) {
+		const bool blocked = buildingBlocks || terrainBlocked[mc].get(tileIndex);
+		if (tileBlocked[mc].get(tileIndex) != blocked) {
+			tileBlocked[mc].set(tileIndex, blocked);
+			changed = true;
+		}
+	}
+	if (changed) {
+		const int tx = tileIndex % numTilesX, tz = tileIndex / numTilesX;
+		tileBlocks[1][(tz >> TILE_BLOCK_SHIFT[1]) * tileBlocksPerRow[1] + (tx >> TILE_BLOCK_SHIFT[1])].lastPassabilityChange = ++passabilityChangeCounter;
+	}
+}
+
+CommonGameState::MovementClass CommonGameState::getMovementClass(const GameObjBlueprint* blueprint)
+{
+	const bool waterUnit = blueprint->canWalkOnWater() && blueprint->bpClass != Tags::GAMEOBJCLASS_FORMATION;
+	return waterUnit ? MOVEMENT_WATER : MOVEMENT_LAND;
+}
+
+void CommonGameState::initTiles()
+{
+	auto area = terrain->getNumPlayableTiles();
+	tiles = std::make_unique<Tile[]>(area.first * area.second);
+	numTilesX = area.first;
+	numTilesZ = area.second;
+	for (int level = 0; level < NUM_TILE_BLOCK_LEVELS; level++) {
+		const int blockSize = 1 << TILE_BLOCK_SHIFT[level];
+		tileBlocksPerRow[level] = (area.first + blockSize - 1) / blockSize;
+		tileBlocks[level].assign(tileBlocksPerRow[level] * ((area.second + blockSize - 1) / blockSize), TileBlock());
+	}
+
+	// passability from the terrain
+	const size_t numTiles = (size_t)numTilesX * numTilesZ;
+	for (int mc = 0; mc < NUM_MOVEMENT_CLASSES; mc++)
+		terrainBlocked[mc].reset(numTiles);
+	for (int tz = 0; tz < numTilesZ; tz++) {
+		for (int tx = 0; tx < numTilesX; tx++) {
+			const auto* trnTile = terrain->getPlayableTile(tx, tz);
+			if (!trnTile)
+				continue;
+			const size_t index = (size_t)tz * numTilesX + tx;
+			const float h[4] = {
+				terrain->getVertex(terrain->edge + tx, terrain->edge + tz),
+				terrain->getVertex(terrain->edge + tx + 1, terrain->edge + tz),
+				terrain->getVertex(terrain->edge + tx, terrain->edge + tz + 1),
+				terrain->getVertex(terrain->edge + tx + 1, terrain->edge + tz + 1)
+			};
+			auto [minH, maxH] = std::minmax_element(std::begin(h), std::end(h));
+			// too deep water or gradients above 45 degrees
+			const bool landBlocked = (trnTile->fullOfWater && trnTile->waterLevel - *minH > 1.5f) || (*maxH - *minH > 5.0f);
+			terrainBlocked[MOVEMENT_LAND].set(index, landBlocked);
+			terrainBlocked[MOVEMENT_WATER].set(index, !trnTile->fullOfWater);
+		}
+	}
+	for (int mc = 0; mc < NUM_MOVEMENT_CLASSES; mc++)
+		tileBlocked[mc] = terrainBlocked[mc];
+}
+
+void CommonGameState::countInTileBlocks(int tileIndex, int objClass, int delta)
+{
+	const int numTilesX = terrain->getNumPlayableTiles().first;
+	const int tx = tileIndex % numTilesX, tz = tileIndex / numTilesX;
+	for (int level = 0; level < NUM_TILE_BLOCK_LEVELS; level++) {
+		TileBlock& block = tileBlocks[level][(tz >> TILE_BLOCK_SHIFT[level]) * tileBlocksPerRow[level] + (tx >> TILE_BLOCK_SHIFT[level])];
+		block.numObjects += delta;
+		uint32_t& count = block.classCounts[objClass];
+		count += delta;
+		if (count)
+			block.classMask |= 1u << objClass;
+		else
+			block.classMask &= ~(1u << objClass);
+	}
+}
+
+void CommonGameState::moveToTile(CommonGameObject* object, int newTileIndex)
+{
+	if (object->tileIndex != -1) {
+		auto& vec = tiles[object->tileIndex].objList;
+		assert(vec[object->tileSlot] == object->id);
+		if ((size_t)object->tileSlot != vec.size() - 1) {
+			vec[object->tileSlot] = vec.back();
+			if (CommonGameObject* moved = vec.back().getFrom(this))
+				moved->tileSlot = object->tileSlot;
 		}
+		vec.pop_back();
+		countInTileBlocks(object->tileIndex, object->tileClass, -1);
+		markTileChanged(object->tileIndex);
 	}
+	object->tileIndex = newTileIndex;
+	object->tileSlot = -1;
+	if (newTileIndex != -1) {
+		auto& vec = tiles[newTileIndex].objList;
+		object->tileSlot = (int)vec.size();
+		vec.push_back(object->id);
+		object->tileClass = object->blueprint->bpClass;
+		countInTileBlocks(newTileIndex, object->tileClass, 1);
+		markTileChanged(newTileIndex);
+	}
+}
+
+void CommonGameState::updateTileClass(CommonGameObject* object)
+{
+	if (object->tileIndex != -1 && object->tileClass != object->blueprint->bpClass) {
+		countInTileBlocks(object->tileIndex, object->tileClass, -1);
+		object->tileClass = object->blueprint->bpClass;
+		countInTileBlocks(object->tileIndex, object->tileClass, 1);
+	}
+}
+
+namespace {
+	// Removes the object at the given slot of the list, moving the last one to its place
+	void RemoveFromRegistryList(std::vector<CommonGameObject*>& vec, int slot, int CommonGameObject::* slotMember)
+	{
+		assert(slot >= 0 && (size_t)slot < vec.size());
+		if ((size_t)slot != vec.size() - 1) {
+			vec[slot] = vec.back();
+			vec[slot]->*slotMember = slot;
+		}
+		vec.pop_back();
+	}
+
+	const std::vector<CommonGameObject*> g_noObjects;
+}
+
+void CommonGameState::updateRegistration(CommonGameObject* object)
+{
+	object->updateCachedPlayer();
+	if (!object->parent) {
+		unregister(object);
+		return;
+	}
+	const CommonGameObject* player = object->getPlayer();
+	const uint32_t playerId = player ? player->id : 0;
+	if (object->registryBlueprint == object->blueprint && object->registryPlayer == playerId)
+		return;
+	unregister(object);
+	PlayerObjects& objects = playerObjects[playerId];
+	auto& bpList = objects.byBlueprint[object->blueprint];
+	object->registryBlueprintSlot = (int)bpList.size();
+	bpList.push_back(object);
+	auto& classList = objects.byClass[object->blueprint->bpClass];
+	object->registryClassSlot = (int)classList.size();
+	classList.push_back(object);
+	object->registryPlayer = playerId;
+	object->registryBlueprint = object->blueprint;
+}
+
+void CommonGameState::updateSubtreeRegistration(CommonGameObject* object)
+{
+	updateRegistration(object);
+	for (auto& [_, children] : object->children)
+		for (CommonGameObject* child : children)
+			updateSubtreeRegistration(child);
+}
+
+void CommonGameState::unregister(CommonGameObject* object)
+{
+	if (!object->registryBlueprint)
+		return;
+	PlayerObjects& objects = playerObjects.at(object->registryPlayer);
+	RemoveFromRegistryList(objects.byBlueprint.at(object->registryBlueprint), object->registryBlueprintSlot, &CommonGameObject::registryBlueprintSlot);
+	RemoveFromRegistryList(objects.byClass[object->registryBlueprint->bpClass], object->registryClassSlot, &CommonGameObject::registryClassSlot);
+	object->registryPlayer = 0;
+	object->registryBlueprint = nullptr;
+	object->registryBlueprintSlot = object->registryClassSlot = -1;
+}
+
+const std::vector<CommonGameObject*>& CommonGameState::getPlayerObjects(const CommonGameObject* player, const GameObjBlueprint* blueprint) const
+{
+	auto it = playerObjects.find(player ? player->id : 0);
+	if (it == playerObjects.end())
+		return g_noObjects;
+	auto bpit = it->second.byBlueprint.find(blueprint);
+	return (bpit != it->second.byBlueprint.end()) ? bpit->second : g_noObjects;
+}
+
+const std::vector<CommonGameObject*>& CommonGameState::getPlayerObjectsOfClass(const CommonGameObject* player, int objClass) const
+{
+	auto it = playerObjects.find(player ? player->id : 0);
+	if (it == playerObjects.end() || objClass < 0 || objClass >= Tags::GAMEOBJCLASS_COUNT)
+		return g_noObjects;
+	return it->second.byClass[objClass];
+}
+
+void CommonGameState::markTileChanged(int tileIndex)
+{
+	const int numTilesX = terrain->getNumPlayableTiles().first;
+	const int tx = tileIndex % numTilesX, tz = tileIndex / numTilesX;
+	tileBlocks[0][(tz >> TILE_BLOCK_SHIFT[0]) * tileBlocksPerRow[0] + (tx >> TILE_BLOCK_SHIFT[0])].lastChange = ++tileChangeCounter;
+}
+
+bool CommonGameState::tilesChangedSince(uint64_t stamp, const Vector3& center, float radius) const
+{
+	if (tileBlocks[0].empty())
+		return false;
+	auto area = terrain->getNumPlayableTiles();
+	auto blockCoord = [](float v, int numTiles) {
+		int t = (int)std::floor(std::clamp(v / 5.0f, 0.0f, (float)(numTiles - 1)));
+		return t >> TILE_BLOCK_SHIFT[0];
+	};
+	const int minX = blockCoord(center.x - radius, area.first), maxX = blockCoord(center.x + radius, area.first);
+	const int minZ = blockCoord(center.z - radius, area.second), maxZ = blockCoord(center.z + radius, area.second);
+	for (int bz = minZ; bz <= maxZ; bz++)
+		for (int bx = minX; bx <= maxX; bx++)
+			if (tileBlocks[0][bz * tileBlocksPerRow[0] + bx].lastChange > stamp)
+				return true;
+	return false;
 }
@@ -17,6 +17,8 @@
 #include "Trajectory.h"
 #include "tags.h"
 #include "gameset/GameObjBlueprint.h"
+#include "util/RandomGenerator.h"
+#include "util/ObjectIdMap.h"
 
 struct GameObjBlueprint;
 struct Model;
@@ -34,8 +36,14 @@ struct CommonGameObject {
 
 	CommonGameObject* parent;
 	std::map<GameObjBlueprintIndex, std::vector<CommonGameObject*>> children;
-
-	std::map<int, float> items;
+	CommonGameObject* player; // cached getPlayer(), see updateCachedPlayer
+	int playerSlot = -1; // row/column in CommonGameState::diplomacyMatrix (players only)
+
+	// Items in the layout of the blueprint (GameObjBlueprint::itemSlots) are in a dense array,
+	// the other ones in the overflow map
+	std::vector<float> itemValues;
+	std::vector<bool> itemSlotIsSet; // false if the slot still has the starting value of the blueprint
+	std::map<int, float> overflowItems;
 	std::map<std::pair<int, int>, float> indexedItems;
 
 	Vector3 position, orientation, scale = Vector3(1.0f, 1.0f, 1.0f);
@@ -66,6 +74,13 @@ struct CommonGameObject {
 	int reportedCurrentOrder = -1;
 
 	int tileIndex = -1;
+	int tileSlot = -1; // position in the objList of the tile
+	int tileClass = -1; // class counted in the tile blocks, see CommonGameState::TileBlock
+
+	// Place in the lists of CommonGameState::playerObjects (registryBlueprint is null if not in them)
+	uint32_t registryPlayer = 0;
+	const GameObjBlueprint* registryBlueprint = nullptr;
+	int registryBlueprintSlot = -1, registryClassSlot = -1;
 
 	// City
 	struct CityRectangle {
@@ -81,9 +96,24 @@ struct CommonGameObject {
 
 	float getItem(int item) const;
 	float getIndexedItem(int item, int index) const;
+	// Changes the value of an item locally, without informing anyone
+	void storeItem(int item, float value);
+	// Calls func(item, value) for every item that was changed from the starting value of the blueprint
+	template <typename Func> void forEachChangedItem(Func func) const {
+		for (size_t slot = 0; slot < itemValues.size(); slot++)
+			if (itemSlotIsSet[slot])
+				func(blueprint->slotItems[slot], itemValues[slot]);
+		for (const auto& [item, value] : overflowItems)
+			func(item, value);
+	}
+	// Changes the blueprint, the changed items are kept, the other ones take the starting values of the new blueprint
+	void changeBlueprint(const GameObjBlueprint* newBlueprint);
 
 	CommonGameObject* getParent() const { return parent; }
-	CommonGameObject* getPlayer() const;
+	// Returns the nearest player object among this object and its ancestors
+	CommonGameObject* getPlayer() const { return player; }
+	// Recomputes the player from the parent, must be called after a parent or class change, from the top of the hierarchy
+	void updateCachedPlayer();
 
 	Matrix getWorldMatrix() const {
 		return Matrix::getScaleMatrix(scale)
@@ -103,6 +133,8 @@ struct CommonGameObject {
 	template<typename AnyGameObject> const AnyGameObject* dyncast() const { return (const AnyGameObject*)this; }
 
 	CommonGameObject(uint32_t id, const GameObjBlueprint *blueprint) : id(id), blueprint(blueprint), parent(nullptr),
+		player((blueprint->bpClass == Tags::GAMEOBJCLASS_PLAYER) ? this : nullptr),
+		itemValues(blueprint->startSlotValues), itemSlotIsSet(blueprint->startSlotValues.size(), false),
 		flags(blueprint->getStartingFlags()) {}
 };
 
@@ -119,10 +151,13 @@ struct CommonGameState {
 	std::shared_ptr<const GameSet> gameSet = nullptr;
 
 	CommonGameObject* level = nullptr;
-	std::map<uint32_t, CommonGameObject*> idmap;
+	ObjectIdMap<CommonGameObject> idmap;
 
 	std::map<int, std::unordered_set<CmnGORef>> aliases;
-	std::map<std::pair<int, int>, int> diplomaticStatuses;
+	// Diplomatic statuses between the players, indexed by playerSlot * numPlayerSlots + playerSlot.
+	// -1 if never set, meaning the default status of the gameset.
+	std::vector<int> diplomacyMatrix;
+	int numPlayerSlots = 0;
 
 	struct Tile {
 		std::vector<CmnGORef> objList;
@@ -133,11 +168,56 @@ struct CommonGameState {
 	};
 	std::unique_ptr<Tile[]> tiles;
 	Terrain* terrain = nullptr;
+	int numTilesX = 0, numTilesZ = 0; // size of the tile array
+
+	// Passability of the tiles for every way of moving, one bit per tile (set = blocked),
+	// so that the pathfinding doesn't have to look at the terrain and the buildings for every tile
+	enum MovementClass { MOVEMENT_LAND = 0, MOVEMENT_WATER, NUM_MOVEMENT_CLASSES };
+	struct TileBits {
+		std::vector<uint64_t> bits;
+		void reset(size_t numTiles) { bits.assign((numTiles + 63) / 64, 0); }
+		bool get(size_t index) const { return (bits[index >> 6] >> (index & 63)) & 1; }
+		void set(size_t index, bool value) {
+			if (value) bits[index >> 6] |= (uint64_t)1 << (index & 63);
+			else bits[index >> 6] &= ~((uint64_t)1 << (index & 63));
+		}
+	};
+	TileBits terrainBlocked[NUM_MOVEMENT_CLASSES]; // slopes, water, land
+	TileBits tileBlocked[NUM_MOVEMENT_CLASSES];    // terrainBlocked + impassable building footprints
+
+	// Number of objects of every class in blocks of 4x4 tiles (level 0) and 16x16 tiles (level 1),
+	// so that searches over large areas can skip the regions without the objects they look for
+	static constexpr int NUM_TILE_BLOCK_LEVELS = 2;
+	static constexpr int TILE_BLOCK_SHIFT[NUM_TILE_BLOCK_LEVELS] = { 2, 4 };
+	struct TileBlock {
+		uint64_t lastChange = 0; // value of tileChangeCounter when an object in it last moved (level 0 only)
+		uint64_t lastPassabilityChange = 0; // value of passabilityChangeCounter when a tile in it became blocked or free (level 1 only)
+		uint32_t numObjects = 0;
+		uint32_t classMask = 0; // bit (1 << class) set if classCounts[class] > 0
+		uint32_t classCounts[Tags::GAMEOBJCLASS_COUNT] = {};
+	};
+	std::vector<TileBlock> tileBlocks[NUM_TILE_BLOCK_LEVELS];
+	int tileBlocksPerRow[NUM_TILE_BLOCK_LEVELS] = {};
+	uint64_t tileChangeCounter = 0;
+	uint64_t passabilityChangeCounter = 0;
+
+	// Objects of every player (key: player ID, 0 for the objects without a player) by blueprint and by class,
+	// so that the finders looking for the objects of a type don't have to walk through the object tree.
+	// Only the objects with a parent are in the lists.
+	struct PlayerObjects {
+		std::unordered_map<const GameObjBlueprint*, std::vector<CommonGameObject*>> byBlueprint;
+		std::vector<CommonGameObject*> byClass[Tags::GAMEOBJCLASS_COUNT];
+	};
+	std::map<uint32_t, PlayerObjects> playerObjects;
+
+	RandomGenerator random; // simulation randomness, must only be used by the thread running the game state
 
 	CommonGameObject* getLevel() const { return level; }
-	CommonGameObject* findObject(uint32_t id) { auto it = idmap.find(id); return (it != idmap.end()) ? it->second : nullptr; }
+	CommonGameObject* findObject(uint32_t id) const { return idmap.find(id); }
 
 	int getDiplomaticStatus(CommonGameObject* a, CommonGameObject* b) const;
+	// Changes the diplomatic status locally, without informing anyone
+	void storeDiplomaticStatus(CommonGameObject* a, CommonGameObject* b, int status);
 
 	bool isServer() const { return programType == ProgramType::SERVER; }
 	bool isClient() const { return programType == ProgramType::CLIENT; }
@@ -146,6 +226,44 @@ struct CommonGameState {
 	CommonGameState(ProgramType programType) : programType(programType) {}
 
 	void updateOccupiedTiles(CommonGameObject* object, const Vector3& oldposition, const Vector3& oldorientation, const Vector3& newposition, const Vector3& neworientation);
+
+	// Allocates the tiles and the tile blocks for the size of the terrain, and computes the passability from the terrain
+	void initTiles();
+	// Removes the footprint of the building from the tiles
+	void freeOccupiedTiles(CommonGameObject* object);
+	static MovementClass getMovementClass(const GameObjBlueprint* blueprint);
+	// Tiles outside of the map are blocked
+	bool isTileBlocked(MovementClass movementClass, int tx, int tz) const {
+		if (tx < 0 || tx >= numTilesX || tz < 0 || tz >= numTilesZ)
+			return true;
+		return tileBlocked[movementClass].get((size_t)tz * numTilesX + tx);
+	}
+	// Puts the object in the object list of the tile (-1 = no tile), removing it from its previous tile.
+	// Constant time, but the removal moves the last object of the previous tile to the place of the removed one.
+	void moveToTile(CommonGameObject* object, int newTileIndex);
+	// Must be called when the class of an object in a tile changes
+	void updateTileClass(CommonGameObject* object);
+	// Must be called when an object of the tile moves, appears or disappears, or changes what it is
+	void markTileChanged(int tileIndex);
+	// Returns true if markTileChanged was called for a tile near the circle since tileChangeCounter had the given value
+	bool tilesChangedSince(uint64_t stamp, const Vector3& center, float radius) const;
+	// Updates the cached player of the object and puts the object in the lists of its current player and blueprint,
+	// must be called when one of them might have changed
+	void updateRegistration(CommonGameObject* object);
+	// Same for the object and all its subordinates, for when the object changed parent
+	void updateSubtreeRegistration(CommonGameObject* object);
+	// Removes the object from the lists of playerObjects
+	void unregister(CommonGameObject* object);
+	const std::vector<CommonGameObject*>& getPlayerObjects(const CommonGameObject* player, const GameObjBlueprint* blueprint) const;
+	const std::vector<CommonGameObject*>& getPlayerObjectsOfClass(const CommonGameObject* player, int objClass) const;
+	const TileBlock& getTileBlock(int level, int tx, int tz) const {
+		return tileBlocks[level][(tz >> TILE_BLOCK_SHIFT[level]) * tileBlocksPerRow[level] + (tx >> TILE_BLOCK_SHIFT[level])];
+	}
+
+private:
+	void countInTileBlocks(int tileIndex, int objClass, int delta);
+	void stampFootprint(CommonGameObject* object, const Vector3& position, const Vector3& orientation, bool take);
+	void updateTileBlocked(int tileIndex);
 };
 
 template<typename AnyGameObject, ProgramType PROGTYPE> struct SpecificGameState : CommonGameState {
@@ -5,6 +5,7 @@
 #include "GameObjBlueprint.h"
 #include "gameset.h"
 #include "../tags.h"
+#include <cassert>
 #include <string>
 #include "../file.h"
 #include "finder.h"
@@ -333,7 +334,7 @@ std::string GameObjBlueprint::getFullName() const {
 	return std::string(Tags::GAMEOBJCLASS_tagDict.getStringFromID(bpClass)) + " \"" + name + "\"";
 }
 
-std::tuple<std::string, float, float> GameObjBlueprint::getSound(int sndTag, int subtype) const
+std::tuple<std::string, float, float> GameObjBlueprint::getSound(int sndTag, int subtype, RandomGenerator& random) const
 {
 	const std::vector<GameObjBlueprint::SoundRef>* sndVars = nullptr;
 	auto it = soundMap.find(sndTag);
@@ -355,13 +356,13 @@ std::tuple<std::string, float, float> GameObjBlueprint::getSound(int sndTag, int
 	if (sndVars) {
 		const std::string* path = nullptr;
 		float refDist = 30.0f; float maxDist = 300.0f;
-		const GameObjBlueprint::SoundRef& sndref = sndVars->at(rand() % sndVars->size());
+		const GameObjBlueprint::SoundRef& sndref = sndVars->at(random.nextInt(sndVars->size()));
 		if (sndref.soundBlueprint != -1) {
 			GSSound& snd = gameSet->sounds[sndref.soundBlueprint];
 			refDist = snd.gradientStartDist;
 			//maxDist = snd.muteDist;
 			if (snd.files.size() > 0)
-				path = &snd.files[rand() % snd.files.size()];
+				path = &snd.files[random.nextInt(snd.files.size())];
 		}
 		else if (!sndref.filePath.empty()) {
 			path = &sndref.filePath;
@@ -402,7 +403,7 @@ Model* GameObjBlueprint::getModel(int subtype, int appearance, int animationInde
 	return nullptr;
 }
 
-Model* GameObjBlueprint::getSpecialEffect(int sfxTag) const
+Model* GameObjBlueprint::getSpecialEffect(int sfxTag, RandomGenerator& random) const
 {
 	auto it = specialEffectMap.find(sfxTag);
 	const std::vector<Model*>* vec;
@@ -411,7 +412,7 @@ Model* GameObjBlueprint::getSpecialEffect(int sfxTag) const
 	else
 		vec = &it->second;
 	if (!vec->empty()) {
-		return (*vec)[rand() % vec->size()];
+		return (*vec)[random.nextInt(vec->size())];
 	}
 	return nullptr;
 }
@@ -427,6 +428,28 @@ float GameObjBlueprint::getStartingItemValue(int itemIndex) const
 	return it->second;
 }
 
+void GameObjBlueprint::buildItemLayout(size_t numItems)
+{
+	// The items given by the blueprint and the ones set by the engine.
+	// The objects a script writes an item to are only known when it runs,
+	// so the other items written by scripts go in the overflow map.
+	itemSlots.assign(numItems, -1);
+	slotItems.clear();
+	startSlotValues.clear();
+	const auto addItem = [this](int item, float startValue) {
+		if (item < 0 || (size_t)item >= itemSlots.size() || itemSlots[item] != -1)
+			return;
+		assert(slotItems.size() < INT16_MAX);
+		itemSlots[item] = (int16_t)slotItems.size();
+		slotItems.push_back(item);
+		startSlotValues.push_back(startValue);
+	};
+	for (const auto& [item, value] : startItemValues)
+		addItem(item, value);
+	for (int item = 0; item < Tags::PDITEM_COUNT; item++)
+		addItem(item, 0.0f);
+}
+
 int GameObjBlueprint::getStartingFlags() const
 {
 	int flags = 0;
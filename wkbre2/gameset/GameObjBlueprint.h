@@ -20,6 +20,7 @@ struct Reaction;
 struct ValueDeterminer;
 struct Footprint;
 struct ObjectFinder;
+struct RandomGenerator;
 
 struct GameObjBlueprint {
 	struct BPAppearance {
@@ -52,6 +53,12 @@ struct GameObjBlueprint {
 
 	std::map<int, float> startItemValues;
 
+	// Layout of the dense item array of the objects (CommonGameObject::itemValues):
+	// slot of every item, -1 if the item isn't stored there (then it goes in the overflow map)
+	std::vector<int16_t> itemSlots;
+	std::vector<int> slotItems; // item of every slot
+	std::vector<float> startSlotValues; // initial content of the item array
+
 	IndexedStringList subtypeNames;
 	std::map<int, PhysicalSubtype> subtypes;
 	std::string modelPath;
@@ -111,14 +118,16 @@ struct GameObjBlueprint {
 	uint32_t getFullId() const;
 	std::string getFullName() const;
 
-	std::tuple<std::string, float, float> getSound(int sndTag, int subtype) const;
+	std::tuple<std::string, float, float> getSound(int sndTag, int subtype, RandomGenerator& random) const;
 	const BPAppearance* getAppearance(int subtype, int appear) const;
 	Model* getModel(int subtype, int appear, int anim, int variant) const;
-	Model* getSpecialEffect(int sfxTag) const;
+	Model* getSpecialEffect(int sfxTag, RandomGenerator& random) const;
 
 	bool canWalkOnWater() const;
 
 	float getStartingItemValue(int itemIndex) const;
+	int getItemSlot(int itemIndex) const { return ((size_t)itemIndex < itemSlots.size()) ? itemSlots[itemIndex] : -1; }
+	void buildItemLayout(size_t numItems);
 	int getStartingFlags() const;
 
 	//GameObjBlueprint() {}
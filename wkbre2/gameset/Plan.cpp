@@ -154,7 +154,7 @@ struct PFNDeployArmyFrom : PlanNodeBlueprint {
 			ServerGameObject* army = ctx->server->createObject(schedule->armyType);
 			army->setParent(settlement->getPlayer());
 			for (auto& spawn : schedule->spawnCharacters) {
-				ServerGameObject* building = buildingCandidates[rand() % buildingCandidates.size()];
+				ServerGameObject* building = buildingCandidates[ctx->server->random.nextInt(buildingCandidates.size())];
 				// create the units
 				auto _ = ctx->changeSelf(army);
 				int numUnits = (int)spawn.count->eval(ctx); // Not sure what should be the SELF
@@ -206,7 +206,7 @@ struct PFNChooseAtRandom : PlanNodeBlueprint {
 	}
 	virtual void reset(PlanNodeState* state) override {
 		State* s = (State*)state;
-		s->index = rand() % sequence.nodes.size();
+		s->index = Server::instance->random.nextInt(sequence.nodes.size());
 		s->seqState.currentNode = s->index;
 		sequence.nodes[s->index]->reset(s->seqState.nodeStates[s->index]);
 	}
@@ -10,9 +10,12 @@
 #include "../server.h"
 #include "ScriptContext.h"
 #include "../BreakpointManager.h"
+#include "../ScriptProfiler.h"
 #include "../settings.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <string_view>
 #include <nlohmann/json.hpp>
 
@@ -234,7 +237,8 @@ struct ActionExecuteSequenceAfterDelay : Action {
 		//ds.selfs = finder->eval(ctx);
 		for (ServerGameObject *obj : finder->eval(ctx))
 			ds.selfs.emplace_back(obj);
-		game_time_t atTime = Server::instance->timeManager.currentTime + delay->eval(ctx);
+		const float delaySec = std::max(0.0f, delay->eval(ctx));
+		uint32_t atTime = Server::instance->timeManager.psCurrentTime + (uint32_t)std::lround(delaySec * 1000.0f);
 		Server::instance->delayedSequences.insert(std::make_pair(atTime, ds));
 	}
 	virtual void parse(GSFileParser & gsf, const GameSet & gs) override {
@@ -268,7 +272,7 @@ struct ActionExecuteOneAtRandom : Action {
 	ActionSequence actionseq;
 	virtual void run(SrvScriptContext* ctx) override {
 		if (!actionseq.actionList.empty()) {
-			int x = rand() % actionseq.actionList.size();
+			int x = ctx->server->random.nextInt(actionseq.actionList.size());
 			if (actionseq.debugInfo) {
 				BreakpointManager::instance().checkAndBreak(actionseq.debugInfo->fileIndex, actionseq.debugInfo->actionLineIndices[x]);
 			}
@@ -1717,6 +1721,15 @@ void ActionSequence::addActionFromGsf(GSFileParser& gsf, const GameSet& gs)
 
 void ActionSequence::run(SrvScriptContext* ctx) const {
 	const bool hasDebugInfo = debugInfo.get();
+	ScriptProfileEntry* profileEntry = nullptr;
+	if (hasDebugInfo && ScriptProfiler::isEnabled()) {
+		// sequences without a name (in reactions, orders, ...) are identified by their location
+		if (!debugInfo->profileEntry)
+			debugInfo->profileEntry = ScriptProfiler::instance().addEntry(ScriptProfileEntry::ACTION_SEQUENCE,
+				ctx->server->gameSet->gsfFileList.getString(debugInfo->fileIndex) + ":" + std::to_string(debugInfo->actionLineIndices[0]));
+		profileEntry = debugInfo->profileEntry;
+	}
+	ScriptProfiler::Scope _prof(profileEntry);
 	for (size_t i = 0; i < actionList.size(); ++i) {
 		if (hasDebugInfo) {
 			BreakpointManager::instance().checkAndBreak(debugInfo->fileIndex, debugInfo->actionLineIndices[i]);
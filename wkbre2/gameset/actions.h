@@ -11,6 +11,7 @@ struct ServerGameObject;
 struct GSFileParser;
 struct GameSet;
 struct SrvScriptContext;
+struct ScriptProfileEntry;
 
 struct Action {
 	virtual ~Action() {}
@@ -24,6 +25,7 @@ struct ActionSequence {
 	struct DebugInfo {
 		int fileIndex = -1;
 		std::vector<int> actionLineIndices;
+		ScriptProfileEntry* profileEntry = nullptr;
 	};
 	std::unique_ptr<DebugInfo> debugInfo;
 
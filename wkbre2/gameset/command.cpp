@@ -6,7 +6,9 @@
 #include "gameset.h"
 #include "../util/util.h"
 #include "../server.h"
+#ifndef WKBRE2_HEADLESS
 #include "../window.h"
+#endif
 #include "../gameset/ScriptContext.h"
 #include <algorithm>
 
@@ -23,7 +25,9 @@ void Command::parse(GSFileParser &gsf, GameSet &gs) {
 			auto path = gsf.nextString(true);
 			if (path == "CURSOR") // needs to bypass one oddity
 				path = gsf.nextString(true);
+#ifndef WKBRE2_HEADLESS
 			cursor = WndCreateCursor(path.c_str());
+#endif
 		}
 		else if (strtag == "CURSOR_CONDITION")
 			cursorConditions.push_back(gs.equations.readIndex(gsf));
@@ -31,8 +35,12 @@ void Command::parse(GSFileParser &gsf, GameSet &gs) {
 			iconConditions.push_back(gs.equations.readIndex(gsf));
 		else if (strtag == "CURSOR_AVAILABLE") {
 			GSCondition* cond = gs.conditions.readPtr(gsf);
-			WndCursor* cursor = WndCreateCursor(gsf.nextString(true).c_str());
-			cursorAvailable.push_back({ cond, cursor });
+			std::string path = gsf.nextString(true);
+#ifndef WKBRE2_HEADLESS
+			cursorAvailable.push_back({ cond, WndCreateCursor(path.c_str()) });
+#else
+			cursorAvailable.push_back({ cond, nullptr });
+#endif
 		}
 		else if (strtag == "BUTTON_ENABLED")
 			buttonEnabled = gsf.nextString(true);
@@ -11,7 +11,9 @@
 #include "CommonEval.h"
 #include "../NNSearch.h"
 #include "ScriptContext.h"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iterator>
 
 ObjectFinderResult ObjectFinder::fail(ScriptContext* ctx) {
@@ -19,6 +21,19 @@ ObjectFinderResult ObjectFinder::fail(ScriptContext* ctx) {
 	return {};
 }
 
+CommonGameObject* ObjectFinder::findNearest(ScriptContext* ctx, const Vector3& center, const NearestPredicate& pred) {
+	auto vec = eval(ctx);
+	// ties are kept in the order of the result
+	std::vector<std::pair<float, size_t>> order(vec.size());
+	for (size_t i = 0; i < vec.size(); i++)
+		order[i] = { (vec[i]->position - center).sqlen2xz(), i };
+	std::sort(order.begin(), order.end());
+	for (const auto& [dist, index] : order)
+		if (pred(vec[index]))
+			return vec[index];
+	return nullptr;
+}
+
 struct FinderUnknown : ObjectFinder {
 	std::string name;
 	virtual ObjectFinderResult eval(ScriptContext* ctx) override {
@@ -118,6 +133,10 @@ struct FinderResults : ObjectFinder {
 		if (ofd == -1) return {}; // TODO: Remove this after implementing exception handling
 		return ctx->gameState->gameSet->objectFinderDefinitions[ofd]->eval(ctx);
 	}
+	virtual CommonGameObject* findNearest(ScriptContext* ctx, const Vector3& center, const NearestPredicate& pred) override {
+		if (ofd == -1) return nullptr;
+		return ctx->gameState->gameSet->objectFinderDefinitions[ofd]->findNearest(ctx, center, pred);
+	}
 	virtual void parse(GSFileParser &gsf, const GameSet &gs) override {
 		ofd = gs.objectFinderDefinitions.readIndex(gsf);
 	}
@@ -215,18 +234,14 @@ struct FinderSequenceExecutor : ObjectFinder {
 struct FinderNearestToSatisfy : ObjectFinder {
 	std::unique_ptr<ValueDeterminer> vdcond, vdradius;
 	virtual ObjectFinderResult eval(ScriptContext* ctx) override {
-		using AnyGO = CommonGameObject;
 		float radius = vdradius->eval(ctx);
-		NNSearch search;
-		search.start(ctx->gameState, ctx->getSelf()->position, radius);
-		ObjectFinderResult res;
-		while (AnyGO* obj = (AnyGO*)search.next()) {
-			if (!obj->isInteractable()) continue;
+		CommonGameObject* obj = NNNearestSearch::findFirst(ctx->gameState, ctx->getSelf()->position, radius, [&](CommonGameObject* obj) {
+			if (!obj->isInteractable()) return false;
 			auto _ = ctx->change(ctx->candidate, obj);
-			if (vdcond->eval(ctx) > 0.0f)
-				res.push_back(obj);
-		}
-		return res;
+			return vdcond->eval(ctx) > 0.0f;
+		});
+		if (obj) return { obj };
+		else return {};
 	}
 	virtual void parse(GSFileParser &gsf, const GameSet &gs) override {
 		vdcond.reset(ReadValueDeterminer(gsf, gs));
@@ -339,24 +354,22 @@ struct FinderSelectedObject : ObjectFinder {
 
 struct FinderAgAllOfType : ObjectFinder {
 	const GameObjBlueprint* blueprint;
+	// the objects nested in an object of the same blueprint are not found
+	bool hasAncestorOfType(CommonGameObject* obj) const {
+		for (CommonGameObject* par = obj->getParent(); par; par = par->getParent())
+			if (par->blueprint == blueprint)
+				return true;
+		return false;
+	}
 	virtual ObjectFinderResult eval(ScriptContext* ctx) override {
-		const auto bpIndex = GameObjBlueprintIndex(blueprint);
 		ObjectFinderResult vec;
-		auto walk = [bpIndex, &vec](CommonGameObject* obj, auto& rec) -> void {
-			for (const auto& subords : obj->children) {
-				if (subords.first == bpIndex) {
-					for (CommonGameObject* sub : subords.second) {
-						vec.push_back((CommonGameObject*)sub);
-					}
-				}
-				else {
-					for (CommonGameObject* sub : subords.second) {
-						rec(sub, rec);
-					}
-				}
-			}
-		};
-		walk(Server::instance->getLevel(), walk);
+		for (const auto& [_, objects] : ctx->gameState->playerObjects) {
+			auto it = objects.byBlueprint.find(blueprint);
+			if (it != objects.byBlueprint.end())
+				for (CommonGameObject* obj : it->second)
+					if (!hasAncestorOfType(obj))
+						vec.push_back(obj);
+		}
 		return vec;
 	}
 	virtual void parse(GSFileParser& gsf, const GameSet& gs) override {
@@ -462,6 +475,14 @@ struct FinderSubordinates : ObjectFinder {
 				if (eligible(par, ctx))
 					results.push_back(par);
 			}
+			// all subordinates of a player of some type are directly in the player's object lists
+			if (!immediateLevel && (objbp || bpclass != -1) && par->blueprint->bpClass == Tags::GAMEOBJCLASS_PLAYER) {
+				const auto& objects = objbp ? ctx->gameState->getPlayerObjects(par, objbp) : ctx->gameState->getPlayerObjectsOfClass(par, bpclass);
+				for (CommonGameObject* obj : objects)
+					if (obj != par && eligible(obj, ctx))
+						results.push_back(obj);
+				continue;
+			}
 			walk(par, ctx);
 		}
 		return std::move(results);
@@ -588,6 +609,16 @@ struct FinderFilter : ObjectFinder {
 		}
 		return res;
 	}
+	virtual CommonGameObject* findNearest(ScriptContext* ctx, const Vector3& center, const NearestPredicate& pred) override {
+		return finder->findNearest(ctx, center, [&](CommonGameObject* obj) {
+			{
+				auto _ = ctx->change(ctx->candidate, obj);
+				if (ctx->gameState->gameSet->equations[equation]->eval(ctx) <= 0.0f)
+					return false;
+			}
+			return pred(obj);
+		});
+	}
 	virtual void parse(GSFileParser &gsf, const GameSet &gs) override {
 		equation = gs.equations.readIndex(gsf);
 		finder.reset(ReadFinderNode(gsf, gs));
@@ -599,6 +630,8 @@ struct FinderMetreRadius : ObjectFinder {
 	bool useOriginalSelf = false;
 	int relationship = 0;
 	int classFilter = 0;
+	static constexpr uint32_t classMasks[4] = { NNCircleSearch::ALL_CLASSES, 1u << Tags::GAMEOBJCLASS_BUILDING,
+		1u << Tags::GAMEOBJCLASS_CHARACTER, (1u << Tags::GAMEOBJCLASS_BUILDING) | (1u << Tags::GAMEOBJCLASS_CHARACTER) };
 
 	template<typename AnyGO> bool eligible(AnyGO* obj, AnyGO* refplayer, ScriptContext* ctx) {
 		if (!obj->isInteractable()) return false;
@@ -622,14 +655,23 @@ struct FinderMetreRadius : ObjectFinder {
 		using AnyGO = CommonGameObject;
 		float radius = vdradius->eval(ctx);
 		AnyGO* player = (useOriginalSelf ? ctx->get(ctx->chainOriginalSelf) : ctx->getSelf())->getPlayer();
-		NNSearch search;
-		search.start(ctx->gameState, ctx->getSelf()->position, radius);
 		ObjectFinderResult res;
-		while (AnyGO* obj = (AnyGO*)search.next())
+		NNCircleSearch::forEach(ctx->gameState, ctx->getSelf()->position, radius, [&](AnyGO* obj) {
 			if (eligible(obj, player, ctx))
 				res.push_back(obj);
+		}, classMasks[classFilter]);
 		return res;
 	}
+	virtual CommonGameObject* findNearest(ScriptContext* ctx, const Vector3& center, const NearestPredicate& pred) override {
+		using AnyGO = CommonGameObject;
+		float radius = vdradius->eval(ctx);
+		AnyGO* player = (useOriginalSelf ? ctx->get(ctx->chainOriginalSelf) : ctx->getSelf())->getPlayer();
+		const Vector3 origin = ctx->getSelf()->position;
+		const float searchRadius = std::sqrt((center - origin).sqlen2xz()) + radius;
+		return NNNearestSearch::findFirst(ctx->gameState, center, searchRadius, [&](AnyGO* obj) {
+			return (obj->position - origin).sqlen2xz() <= radius * radius && eligible(obj, player, ctx) && pred(obj);
+		}, classMasks[classFilter]);
+	}
 	virtual void parse(GSFileParser &gsf, const GameSet &gs) override {
 		vdradius.reset(ReadValueDeterminer(gsf, gs));
 		// ...
@@ -694,18 +736,9 @@ struct FinderGradeSelect : ObjectFinder {
 struct FinderNearestCandidate : ObjectFinder {
 	std::unique_ptr<ObjectFinder> finder;
 	virtual ObjectFinderResult eval(ScriptContext* ctx) override {
-		auto vec = finder->eval(ctx);
-		float bestDist = INFINITY;
-		CommonGameObject *bestObj = nullptr;
-		for (CommonGameObject *obj : vec) {
-			float dist = (obj->position - ctx->getSelf()->position).sqlen2xz();
-			if (dist < bestDist) {
-				bestDist = dist;
-				bestObj = obj;
-			}
-		}
-		if (bestObj)
-			return { bestObj };
+		CommonGameObject* obj = finder->findNearest(ctx, ctx->getSelf()->position, [](CommonGameObject*) { return true; });
+		if (obj)
+			return { obj };
 		else
 			return {};
 	}
@@ -719,23 +752,45 @@ struct FinderTileRadius : ObjectFinder {
 	virtual ObjectFinderResult eval(ScriptContext* ctx) override {
 		using AnyGO = CommonGameObject;
 		float radius = vdradius->eval(ctx);
-		NNSearch search;
-		search.start(ctx->gameState, ctx->getSelf()->position, radius);
 		ObjectFinderResult res;
-		while (AnyGO* obj = (AnyGO*)search.next())
+		NNCircleSearch::forEach(ctx->gameState, ctx->getSelf()->position, radius, [&res](AnyGO* obj) {
 			if (obj->isInteractable())
 				res.push_back(obj);
+		});
 		return res;
 	}
+	virtual CommonGameObject* findNearest(ScriptContext* ctx, const Vector3& center, const NearestPredicate& pred) override {
+		float radius = vdradius->eval(ctx);
+		const Vector3 origin = ctx->getSelf()->position;
+		const float searchRadius = std::sqrt((center - origin).sqlen2xz()) + radius;
+		return NNNearestSearch::findFirst(ctx->gameState, center, searchRadius, [&](CommonGameObject* obj) {
+			return (obj->position - origin).sqlen2xz() <= radius * radius && obj->isInteractable() && pred(obj);
+		});
+	}
 	virtual void parse(GSFileParser& gsf, const GameSet& gs) override {
 		vdradius.reset(ReadValueDeterminer(gsf, gs));
 	}
 };
 
 struct FinderDiscoveredUnits : ObjectFinder {
+	// Characters and buildings of the other players on the tiles discovered by the player of self
 	virtual ObjectFinderResult eval(ScriptContext* ctx) override {
-		// TODO
-		return {};
+		if (!ctx->isServer()) return {}; // the client doesn't have the visibility grid
+		Server* server = (Server*)ctx->gameState;
+		ServerGameObject* player = ((ServerGameObject*)ctx->getSelf())->getPlayer();
+		if (!player) return {};
+		ObjectFinderResult res;
+		server->visibility.forEachDiscoveredTile(server->visibility.findPlayerIndex(player->id), [&](int tileIndex) {
+			for (const auto& ref : server->tiles[tileIndex].objList) {
+				ServerGameObject* obj = ref.getFrom<Server>();
+				if (!obj || !obj->isInteractable() || obj->getPlayer() == player)
+					continue;
+				const int cls = obj->blueprint->bpClass;
+				if (cls == Tags::GAMEOBJCLASS_CHARACTER || cls == Tags::GAMEOBJCLASS_BUILDING)
+					res.push_back(obj);
+			}
+		});
+		return res;
 	}
 	virtual void parse(GSFileParser& gsf, const GameSet& gs) override {}
 };
@@ -747,7 +802,7 @@ struct FinderRandomSelection : ObjectFinder {
 		auto vec = finder->eval(ctx);
 		size_t cnt = std::min(vec.size(), (size_t)vCount->eval(ctx));
 		for (size_t i = 0; i < cnt; i++) {
-			size_t s = rand() % (vec.size() - i) + i;
+			size_t s = ctx->gameState->random.nextInt(vec.size() - i) + i;
 			std::swap(vec[i], vec[s]);
 		}
 		vec.resize(cnt);
@@ -773,6 +828,16 @@ struct FinderFilterCandidates : ObjectFinder {
 		}
 		return res;
 	}
+	virtual CommonGameObject* findNearest(ScriptContext* ctx, const Vector3& center, const NearestPredicate& pred) override {
+		return finder->findNearest(ctx, center, [&](CommonGameObject* obj) {
+			{
+				auto _ = ctx->change(ctx->candidate, obj);
+				if (condition->eval(ctx) <= 0.0f)
+					return false;
+			}
+			return pred(obj);
+		});
+	}
 	virtual void parse(GSFileParser& gsf, const GameSet& gs) override {
 		condition.reset(ReadValueDeterminer(gsf, gs));
 		finder.reset(ReadFinderNode(gsf, gs));
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <cstddef>
+#include <functional>
 #include <vector>
 
 struct CommonGameObject;
@@ -15,6 +16,7 @@ struct GameSet;
 struct ScriptContext;
 struct SrvScriptContext;
 struct CliScriptContext;
+struct Vector3;
 
 // Contains the result of an object finder evalutation.
 // Basically a std::vector of CommonGameObject* with a
@@ -114,6 +116,12 @@ struct ObjectFinder {
 	virtual ObjectFinderResult eval(ScriptContext* ctx) = 0;
 	virtual void parse(GSFileParser &gsf, const GameSet &gs) = 0;
 
+	using NearestPredicate = std::function<bool(CommonGameObject*)>;
+	// Returns the object of the result nearest to the center (on the XZ plane) for which pred(obj) is true,
+	// pred being called in distance order. By default the whole result is evaluated and sorted,
+	// finders that search the tiles around self override this to only look at the nearest objects.
+	virtual CommonGameObject* findNearest(ScriptContext* ctx, const Vector3& center, const NearestPredicate& pred);
+
 	CommonGameObject* getFirst(ScriptContext* ctx) {
 		auto objlist = eval(ctx);
 		return objlist.empty() ? nullptr : objlist[0];
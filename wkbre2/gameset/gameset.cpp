@@ -534,6 +534,10 @@ void GameSet::load(const char * fn)
 
 	printf("Gameset pass 2...\n");
 	parseFile(fn, 1);
+
+	for (auto& objbp : objBlueprints)
+		for (GameObjBlueprint& blueprint : objbp.blueprints)
+			blueprint.buildItemLayout(items.size());
 	printf("Gameset loaded!\n");
 }
 
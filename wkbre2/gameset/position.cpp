@@ -435,7 +435,7 @@ struct PDRandomAttachmentPoint : public PositionDeterminer {
 				}
 			}
 			if (numValidAPs > 0) {
-				size_t randomAP = rand() % numValidAPs;
+				size_t randomAP = ctx->gameState->random.nextInt(numValidAPs);
 				return model->getAPInfo(validAPs[randomAP]).staticState.position.transform(obj->getWorldMatrix());
 			}
 		}
@@ -10,11 +10,13 @@
 struct GSFileParser;
 struct GameSet;
 struct PackageReceiptTrigger;
+struct ScriptProfileEntry;
 
 struct Reaction {
 	std::vector<int> events;
 	std::vector<const PackageReceiptTrigger*> prTriggers;
 	ActionSequence actions;
+	ScriptProfileEntry* profileEntry = nullptr;
 
 	void parse(GSFileParser &gsf, GameSet &gs);
 	bool canBeTriggeredBy(int evt, ServerGameObject* obj, ServerGameObject* sender) const;
@@ -19,7 +19,7 @@
 #include "../Pathfinding.h"
 
 namespace {
-	float RandomFromZeroToOne() { return (float)(rand() & 0xFFFF) / 32768.0f; }
+	float RandomFromZeroToOne(ScriptContext* ctx) { return (float)(ctx->gameState->random.next() & 0x7FFF) / 32768.0f; }
 }
 
 //namespace Script
@@ -686,11 +686,39 @@ struct ValueIsDisabled : ValueDeterminer {
 	}
 };
 
+// 1 if all the objects are on tiles visible/discovered by the player (its own objects always are).
+// An object that is not on the map itself (e.g. a unit inside a building) is seen where its closest
+// superior on the map is, and one without any superior on the map (e.g. a player) is always seen.
+static float IsSeenByPlayer(ScriptContext* ctx, ObjectFinder* fObjects, ObjectFinder* fPlayer, bool discovered)
+{
+	if (!ctx->isServer()) return 1.0f; // the client doesn't have the visibility grid
+	Server* server = (Server*)ctx->gameState;
+	auto* player = fPlayer->getFirst(ctx);
+	if (!player) return 0.0f;
+	auto objects = fObjects->eval(ctx);
+	if (objects.empty()) return 0.0f;
+	const int playerIndex = server->visibility.findPlayerIndex(player->id);
+	const int numTilesX = server->terrain->getNumPlayableTiles().first;
+	for (CommonGameObject* obj : objects) {
+		if (obj->getPlayer() == player)
+			continue;
+		const CommonGameObject* onMap = obj;
+		while (onMap && onMap->tileIndex == -1)
+			onMap = onMap->getParent();
+		if (!onMap)
+			continue;
+		const int tx = onMap->tileIndex % numTilesX, tz = onMap->tileIndex / numTilesX;
+		if (!(discovered ? server->visibility.isDiscovered(playerIndex, tx, tz) : server->visibility.isVisible(playerIndex, tx, tz)))
+			return 0.0f;
+	}
+	return 1.0f;
+}
+
+// Always 1 in a match loaded from a savegame made during the match, as the discovered tiles aren't saved
 struct ValueIsDiscovered : ValueDeterminer {
 	std::unique_ptr<ObjectFinder> fObjects, fPlayer;
 	virtual float eval(ScriptContext* ctx) override {
-		// TODO
-		return 1.0f;
+		return IsSeenByPlayer(ctx, fObjects.get(), fPlayer.get(), true);
 	}
 	virtual void parse(GSFileParser& gsf, const GameSet& gs) override {
 		fObjects.reset(ReadFinder(gsf, gs));
@@ -700,8 +728,7 @@ struct ValueIsDiscovered : ValueDeterminer {
 struct ValueIsVisible : ValueDeterminer {
 	std::unique_ptr<ObjectFinder> fObjects, fPlayer;
 	virtual float eval(ScriptContext* ctx) override {
-		// TODO
-		return 1.0f;
+		return IsSeenByPlayer(ctx, fObjects.get(), fPlayer.get(), false);
 	}
 	virtual void parse(GSFileParser& gsf, const GameSet& gs) override {
 		fObjects.reset(ReadFinder(gsf, gs));
@@ -912,7 +939,7 @@ struct EnodeNegate : UnaryEnode {
 };
 
 struct EnodeRandomUpTo : UnaryEnode {
-	virtual float eval(ScriptContext* ctx) override { return RandomFromZeroToOne() * a->eval(ctx); }
+	virtual float eval(ScriptContext* ctx) override { return RandomFromZeroToOne(ctx) * a->eval(ctx); }
 };
 
 struct EnodeRound : UnaryEnode {
@@ -988,14 +1015,14 @@ struct EnodeMin : BinaryEnode {
 struct EnodeRandomInteger : BinaryEnode {
 	virtual float eval(ScriptContext* ctx) override {
 		int x = (int)a->eval(ctx), y = (int)b->eval(ctx);
-		return (float)(rand() % (y - x + 1) + x);
+		return (float)((int)ctx->gameState->random.nextInt(y - x + 1) + x);
 	}
 };
 
 struct EnodeRandomRange : BinaryEnode {
 	virtual float eval(ScriptContext* ctx) override {
 		float x = a->eval(ctx), y = b->eval(ctx);
-		return RandomFromZeroToOne() * (y - x) + x;
+		return RandomFromZeroToOne(ctx) * (y - x) + x;
 	}
 };
 
@@ -12,6 +12,7 @@
 #include "ClientInterface.h"
 #include "../gameset/ScriptContext.h"
 #include "../platform.h"
+#include "../ScriptProfiler.h"
 #include <atomic>
 #include <SDL2/SDL_timer.h>
 
@@ -137,9 +138,10 @@ void ClientDebugger::draw()
 		ImGui::DragFloat2("Orientation", &sel->orientation.x);
 		ImGui::Text("Subtype=%i, Appearance=%i", sel->subtype, sel->appearance);
 		ImGui::Text("Items:");
-		for (auto item : sel->items)
-			if (item.first != -1)
-				ImGui::BulletText("\"%s\": %f", client->gameSet->items.names.getString(item.first).c_str(), item.second);
+		sel->forEachChangedItem([this](int item, float value) {
+			if (item != -1)
+				ImGui::BulletText("\"%s\": %f", client->gameSet->items.names.getString(item).c_str(), value);
+		});
 		ImGui::Text("Commands:");
 		static int targetid = 0;
 		ImGui::InputInt("Target ID", &targetid);
@@ -191,6 +193,7 @@ void ClientDebugger::draw()
 		diagLastCheck = sdlTime;
 	}
 	ImGui::Text("serverTicks/s = %i", serverTicks);
+	ImGui::Text("clientObjects = %zu (peak %zu, pool %zu)", client->objectPool.getLiveCount(), client->objectPool.getPeakCount(), client->objectPool.getCapacity());
 	ImGui::Text("clientMsgs/tick = %i", client->dbgNumMessagesPerTick);
 	ImGui::Text("clientMsgs/s = %i", client->dbgNumMessagesPerSec);
 	ImGui::End();
@@ -272,6 +275,7 @@ void ClientDebugger::draw()
 	}
 
 	client->timeManager.imgui();
+	ScriptProfiler::instance().imgui();
 
 	if (client->gameSet) {
 		gsDebugger.setGameSet(client->gameSet.get());
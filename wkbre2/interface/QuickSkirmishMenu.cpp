@@ -230,7 +230,7 @@ void QuickSkirmishMenu::applySettings(Server& server)
 		for (auto& obj : playerList) {
 			if (obj->id == 1027)
 				continue;
-			int aiTypeIndex = rand() % remainingAiTypes;
+			int aiTypeIndex = (int)server.random.nextInt(remainingAiTypes);
 			const char* aiName = aiPlayerNames[aiTypeIndex];
 			std::swap(aiPlayerNames[aiTypeIndex], aiPlayerNames[remainingAiTypes - 1]);
 			remainingAiTypes -= 1;
@@ -268,7 +268,10 @@ void QuickStartMenu::launchGame()
 				srvMutex.lock();
 				server->tick();
 				srvMutex.unlock();
-				_sleep(1000 / 60);
+				if (server->timeManager.clockMode == TimeManager::ClockMode::FIXED_STEP)
+					_sleep(1000 / server->timeManager.tickRate);
+				else if (server->timeManager.clockMode == TimeManager::ClockMode::REALTIME)
+					_sleep(1000 / 60);
 			}
 			});
 
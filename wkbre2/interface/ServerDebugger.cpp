@@ -30,6 +30,7 @@ void ServerDebugger::draw() {
 	ImGui::End();
 
 	ImGui::Begin("Server Object Tree");
+	ImGui::Text("Objects: %zu (peak %zu, pool %zu)", server->objectPool.getLiveCount(), server->objectPool.getPeakCount(), server->objectPool.getCapacity());
 	const auto walkOnObj = [this](const auto &walkOnObj, ServerGameObject *obj) -> void {
 		bool b = ImGui::TreeNodeEx(obj, ImGuiTreeNodeFlags_DefaultOpen | (obj->children.empty() ? ImGuiTreeNodeFlags_Leaf : 0), "%i: %s \"%s\"", obj->id, Tags::GAMEOBJCLASS_tagDict.getStringFromID(obj->blueprint->bpClass), obj->blueprint->name.c_str());
 		if (ImGui::IsItemClicked())
@@ -65,9 +66,10 @@ void ServerDebugger::draw() {
 		ImGui::Text("Subtype=%i, Appearance=%i", sel->subtype, sel->appearance);
 		
 		if (ImGui::CollapsingHeader("Items")) {
-			for (auto& item : sel->items)
-				if (item.first != -1)
-					ImGui::BulletText("\"%s\": %f", server->gameSet->items.names.getString(item.first).c_str(), item.second);
+			sel->forEachChangedItem([this](int item, float value) {
+				if (item != -1)
+					ImGui::BulletText("\"%s\": %f", server->gameSet->items.names.getString(item).c_str(), value);
+			});
 		}
 
 		auto listAssociations = [&](const decltype(ServerGameObject::associates)& ascMap) {
@@ -158,4 +160,5 @@ void ServerDebugger::draw() {
 	}
 
 	server->timeManager.imgui();
+	server->tickProfiler.imgui();
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "server.h"
 #include "file.h"
 #include "util/GSFileParser.h"
+#include "util/util.h"
 #include "tags.h"
 #include "gameset/gameset.h"
 #include "network.h"
@@ -15,14 +16,53 @@
 #include <nlohmann/json.hpp>
 #include <codecvt>
 #include <atomic>
+#include <tuple>
 #include <locale>
 #include "gameset/finder.h"
 #include "StampdownPlan.h"
+#include "ScriptProfiler.h"
+#include "JobSystem.h"
 
 Server *Server::instance = nullptr;
 
 std::atomic_int g_diag_serverTicks{ 0 };
 
+Server::Server()
+{
+	instance = this;
+	// fixed seed from wkconfig.json to reproduce a match, otherwise a new one every time
+	if (g_settings.is_object() && g_settings.contains("randomSeed"))
+		randomSeed = g_settings.at("randomSeed").get<uint32_t>();
+	else
+		randomSeed = (uint32_t)time(nullptr);
+	for (int i = 0; i < NUM_ACTIVE_LISTS; i++)
+		activeObjects[i].flag = (uint8_t)(1 << i);
+	// "sightCheckPeriod" is either a number of ticks for all classes, or an object with a number per class name
+	std::fill(std::begin(sightCheckPeriods), std::end(sightCheckPeriods), 1);
+	if (g_settings.is_object()) {
+		const auto it = g_settings.find("sightCheckPeriod");
+		if (it != g_settings.end() && it->is_number())
+			std::fill(std::begin(sightCheckPeriods), std::end(sightCheckPeriods), std::max(1, it->get<int>()));
+		else if (it != g_settings.end() && it->is_object()) {
+			for (const auto& item : it->items()) {
+				int cls = Tags::GAMEOBJCLASS_tagDict.getTagID(item.key().c_str());
+				if (cls != -1)
+					sightCheckPeriods[cls] = std::max(1, item.value().get<int>());
+				else
+					printf("Unknown class %s in sightCheckPeriod\n", item.key().c_str());
+			}
+		}
+		sightCheckBudget = std::max(0, g_settings.value<int>("sightCheckBudget", 0));
+		flowFieldMinUnits = std::max(0, g_settings.value<int>("flowFieldMinUnits", flowFieldMinUnits));
+	}
+}
+
+Server::~Server()
+{
+	// the path jobs write into the requests and read the pathfinders
+	cancelPathRequests();
+}
+
 void Server::loadSaveGame(const char * filename)
 {
 	char *filetext; int filesize;
@@ -30,6 +70,13 @@ void Server::loadSaveGame(const char * filename)
 	filetext[filesize] = 0;
 	GSFileParser gsf(filetext);
 
+	// the paths searched for the previous game would be applied to the objects of the new one
+	cancelPathRequests();
+
+	// a RANDOM_STATE line in the savegame will override the seed
+	random.seed(randomSeed);
+	printf("Random seed: %u\n", randomSeed);
+
 	while (!gsf.eof)
 	{
 		std::string strtag = gsf.nextTag();
@@ -39,7 +86,10 @@ void Server::loadSaveGame(const char * filename)
 		case Tags::SAVEGAME_GAME_SET: {
 			std::string gsFileName = gsf.nextString(true);
 			int version = g_settings.at("gameVersion").get<int>();
-			gameSet = std::make_shared<GameSet>(gsFileName.c_str(), version);
+			auto newGameSet = std::make_shared<GameSet>(gsFileName.c_str(), version);
+			ScriptProfiler::setEnabled(g_settings.value<bool>("scriptProfiler", false));
+			ScriptProfiler::instance().instrumentGameSet(*newGameSet);
+			gameSet = newGameSet;
 			NetPacketWriter msg(NETCLIMSG_GAME_SET);
 			msg.writeStringZ(gsFileName);
 			msg.writeUint8((uint8_t)version);
@@ -47,7 +97,10 @@ void Server::loadSaveGame(const char * filename)
 			break;
 		}
 		case Tags::SAVEGAME_NEXT_UNIQUE_ID:
-			nextUniqueId = gsf.nextInt();
+			idmap.reserveIndicesBelow((uint32_t)gsf.nextInt() + 1);
+			break;
+		case Tags::SAVEGAME_RANDOM_STATE:
+			random.state = strtoull(gsf.nextString().c_str(), nullptr, 10);
 			break;
 		case Tags::SAVEGAME_PREDEC:
 			loadSavePredec(gsf); break;
@@ -70,9 +123,17 @@ void Server::loadSaveGame(const char * filename)
 
 	free(filetext);
 
+	// the tiles discovered before the save are unknown, see VisibilityGrid::setEverythingDiscovered
+	visibility.setEverythingDiscovered(isLoadedMidMatch());
+
 	for (auto &t : postAssociations)
 		std::get<0>(t)->associateObject(std::get<1>(t), findObject(std::get<2>(t)));
 
+	// The postponed sight range checks aren't saved, so check every object as soon as possible
+	for (const SrvGORef& ref : activeObjects[ACTIVE_SIGHT_RANGE].objects)
+		if (ServerGameObject* obj = ref.get())
+			obj->sightCheckPending = true;
+
 	for (size_t i = 0; i < clientPlayerObjects.size(); i++)
 		clientPlayerObjects[i]->clientIndex = i;
 
@@ -83,33 +144,42 @@ void Server::loadSaveGame(const char * filename)
 
 ServerGameObject* Server::createObject(const GameObjBlueprint * blueprint, uint32_t id)
 {
+	ServerGameObject *obj = objectPool.create(id, blueprint);
 	if (!id) {
-		while (idmap.count(++nextUniqueId) != 0);
-		id = nextUniqueId;
+		obj->id = idmap.allocate(obj);
+		if (!obj->id)
+			ferr("No more free object IDs!");
+	}
+	else if (!idmap.insert(id, obj)) {
+		printf("WARNING: Object ID %u is used twice!\n", id);
+		idmap.erase(id);
+		idmap.insert(id, obj);
 	}
-	ServerGameObject *obj = new ServerGameObject(id, blueprint);
-	idmap[id] = obj;
 
-	obj->subtype = rand() % blueprint->subtypeNames.size();
+	obj->subtype = random.nextInt(blueprint->subtypeNames.size());
 	auto bpSubtype = blueprint->subtypes.find(obj->subtype);
 	if (bpSubtype != blueprint->subtypes.end()) {
 		auto& stappearances = bpSubtype->second.appearances;
 		if (stappearances.count(0))
 			obj->appearance = 0;
 		else if (!stappearances.empty())
-			obj->appearance = std::next(stappearances.begin(), rand() % stappearances.size())->first;
+			obj->appearance = std::next(stappearances.begin(), random.nextInt(stappearances.size()))->first;
 	}
 
 	NetPacketWriter msg(NETCLIMSG_OBJECT_CREATED);
-	msg.writeUint32(id);
+	msg.writeUint32(obj->id);
 	msg.writeUint32(blueprint->getFullId());
 	msg.writeUint32(obj->subtype);
 	msg.writeUint32(obj->appearance);
 	sendToAll(msg);
 
 	obj->updateSightRange();
+	activateFromBlueprint(obj);
 
-	Vector3 randVec{ (float)rand() / (float)(RAND_MAX), (float)rand() / (float)(RAND_MAX), (float)rand() / (float)(RAND_MAX) };
+	Vector3 randVec;
+	randVec.x = random.nextFloat();
+	randVec.y = random.nextFloat();
+	randVec.z = random.nextFloat();
 	Vector3 varyScale = blueprint->minScaleVary + randVec * (blueprint->maxScaleVary - blueprint->minScaleVary);
 	obj->setScale(blueprint->scaleAppearance * varyScale);
 
@@ -222,12 +292,24 @@ void Server::destroyObject(ServerGameObject* obj)
 	//std::swap(*std::find(vec.begin(), vec.end(), obj), vec.back());
 	//vec.pop_back();
 
+	// remove from its tile
+	if (obj->tileIndex != -1) {
+		moveToTile(obj, -1);
+		updateVisibility(obj);
+	}
+
+	// remove its footprint
+	freeOccupiedTiles(obj);
+
+	// remove from the lists of its player
+	unregister(obj);
+
 	// remove from ID map
 	idmap.erase(obj->id);
 
 	// delete the object, bye!
 	int id = obj->id;
-	delete obj;
+	objectPool.destroy(obj);
 
 	// report removal to the clients
 	NetPacketWriter msg(NETCLIMSG_OBJECT_REMOVED);
@@ -285,8 +367,8 @@ ServerGameObject* Server::loadObject(GSFileParser & gsf, const std::string &clsn
 			NetPacketWriter packet(NETCLIMSG_TERRAIN_SET);
 			packet.writeStringZ(mapfp);
 			sendToAll(packet);
-			auto area = this->terrain->getNumPlayableTiles();
-			this->tiles = std::make_unique<Tile[]>(area.first * area.second);
+			initTiles();
+			visibility.init(terrain->getNumPlayableTiles().first, terrain->getNumPlayableTiles().second);
 			break;
 		}
 		case Tags::GAMEOBJ_COLOUR_INDEX: {
@@ -316,6 +398,7 @@ ServerGameObject* Server::loadObject(GSFileParser & gsf, const std::string &clsn
 					gsf.advanceLine();
 					const OrderBlueprint &orderBp = gameSet->orders[orderType];
 					obj->orderConfig.orders.emplace_back(0, &orderBp, obj);
+					activeObjects[ACTIVE_ORDERS].add(obj);
 					Order &order = obj->orderConfig.orders.back();
 					while(!gsf.eof) {
 						std::string ordtag = gsf.nextTag();
@@ -426,7 +509,7 @@ ServerGameObject* Server::loadObject(GSFileParser & gsf, const std::string &clsn
 			break;
 		}
 		case Tags::GAMEOBJ_NEXT_UNIQUE_ID: {
-			this->nextUniqueId = gsf.nextInt();
+			idmap.reserveIndicesBelow((uint32_t)gsf.nextInt() + 1);
 			break;
 		}
 		case Tags::GAMEOBJ_TILES: {
@@ -521,6 +604,36 @@ ServerGameObject* Server::loadObject(GSFileParser & gsf, const std::string &clsn
 	return obj;
 }
 
+void Server::activateFromBlueprint(ServerGameObject* obj)
+{
+	const GameObjBlueprint* bp = obj->blueprint;
+	if (bp->receiveSightRangeEvents)
+		activeObjects[ACTIVE_SIGHT_RANGE].add(obj);
+	if (bp->removeWhenNotReferenced)
+		activeObjects[ACTIVE_REMOVE_UNREFERENCED].add(obj);
+	if (bp->bpClass == Tags::GAMEOBJCLASS_PLAYER)
+		activeObjects[ACTIVE_PLAYER].add(obj);
+	else if (bp->bpClass == Tags::GAMEOBJCLASS_ARMY)
+		activeObjects[ACTIVE_ARMY].add(obj);
+	else if (bp->bpClass == Tags::GAMEOBJCLASS_FORMATION)
+		activeObjects[ACTIVE_FORMATION].add(obj);
+}
+
+void Server::updateVisibility(ServerGameObject* obj)
+{
+	VisibilityGrid::Stamp stamp;
+	const float sightRange = obj->getItem(Tags::PDITEM_ACTUAL_SIGHT_RANGE); // in tiles
+	ServerGameObject* player = obj->getPlayer();
+	if (obj->tileIndex != -1 && sightRange > 0.0f && player && player != obj) {
+		const int numTilesX = terrain->getNumPlayableTiles().first;
+		stamp.playerIndex = visibility.getPlayerIndex(player->id);
+		stamp.tx = obj->tileIndex % numTilesX;
+		stamp.tz = obj->tileIndex / numTilesX;
+		stamp.radius = (int)sightRange;
+	}
+	visibility.changeStamp(obj->sightStamp, stamp);
+}
+
 void Server::loadSavePredec(GSFileParser & gsf)
 {
 	gsf.advanceLine();
@@ -551,7 +664,9 @@ void ServerGameObject::setItem(int index, float value)
 {
 	assert(index != -1);
 	if (getItem(index) == value) return;
-	items[index] = value;
+	storeItem(index, value);
+	if (index == Tags::PDITEM_ACTUAL_SIGHT_RANGE)
+		Server::instance->updateVisibility(this);
 
 	NetPacketWriter msg(NETCLIMSG_OBJECT_ITEM_SET);
 	msg.writeUint32(this->id);
@@ -577,6 +692,16 @@ void ServerGameObject::setParent(ServerGameObject * newParent)
 	if(newParent)
 		newParent->children[this->blueprint].push_back(this);
 
+	// the player of the object and its subordinates might have changed
+	const auto updatePlayer = [](ServerGameObject* obj, auto& rec) -> void {
+		Server::instance->updateRegistration(obj);
+		Server::instance->updateVisibility(obj);
+		for (auto& [_, children] : obj->children)
+			for (CommonGameObject* child : children)
+				rec((ServerGameObject*)child, rec);
+	};
+	updatePlayer(this, updatePlayer);
+
 	NetPacketWriter msg(NETCLIMSG_OBJECT_PARENT_SET);
 	msg.writeUint32(this->id);
 	msg.writeUint32(newParent->id);
@@ -625,7 +750,7 @@ void ServerGameObject::setSubtypeAndAppearance(int new_subtype, int new_appearan
 		auto& stappearances = bpSubtype->second.appearances;
 		if (stappearances.count(new_appearance) == 0) {
 			if (!stappearances.empty())
-				new_appearance = std::next(stappearances.begin(), rand() % stappearances.size())->first;
+				new_appearance = std::next(stappearances.begin(), Server::instance->random.nextInt(stappearances.size()))->first;
 			else
 				new_appearance = 0;
 		}
@@ -674,6 +799,7 @@ void ServerGameObject::startMovement(const Vector3 & destination)
 {
 	float speed = computeSpeed();
 	movement.startMovement(position, destination, Server::instance->timeManager.currentTime, speed);
+	Server::instance->activeObjects[Server::ACTIVE_MOVEMENT].add(this);
 	currentSpeed = speed;
 	NetPacketWriter npw{ NETCLIMSG_OBJECT_MOVEMENT_STARTED };
 	npw.writeUint32(this->id);
@@ -723,12 +849,18 @@ void ServerGameObject::sendEvent(int evt, ServerGameObject * sender)
 	SrvScriptContext ctx(Server::instance, this);
 	auto _ = ctx.change(ctx.packageSender, sender);
 	const auto ircopy = individualReactions;
-	for (const Reaction* r : ircopy)
-		if (r->canBeTriggeredBy(evt, this, sender))
+	for (const Reaction* r : ircopy) {
+		if (r->canBeTriggeredBy(evt, this, sender)) {
+			ScriptProfiler::Scope _prof(r->profileEntry);
 			r->actions.run(&ctx);
-	for (const Reaction *r : blueprint->intrinsicReactions)
-		if (r->canBeTriggeredBy(evt, this, sender))
+		}
+	}
+	for (const Reaction *r : blueprint->intrinsicReactions) {
+		if (r->canBeTriggeredBy(evt, this, sender)) {
+			ScriptProfiler::Scope _prof(r->profileEntry);
 			r->actions.run(&ctx);
+		}
+	}
 }
 
 void ServerGameObject::associateObject(int category, ServerGameObject * associated)
@@ -763,7 +895,8 @@ void ServerGameObject::convertTo(const GameObjBlueprint * postbp)
 	// backup of previous blueprint
 	const GameObjBlueprint* prevbp = blueprint;
 	// now converted!
-	blueprint = postbp;
+	changeBlueprint(postbp);
+	Server::instance->updateRegistration(this);
 	// inform the clients
 	NetPacketWriter npw{ NETCLIMSG_OBJECT_CONVERTED };
 	npw.writeUint32(this->id);
@@ -774,6 +907,10 @@ void ServerGameObject::convertTo(const GameObjBlueprint * postbp)
 	this->setSubtypeAndAppearance((postsubtype != -1) ? postsubtype : 0, 0); // TODO: random subtype as fallback?
 	// update sight range
 	this->updateSightRange();
+	Server::instance->activateFromBlueprint(this);
+	Server::instance->updateTileClass(this);
+	if (tileIndex != -1)
+		Server::instance->markTileChanged(tileIndex);
 	// update footprint
 	this->updateOccupiedTiles(this->position, this->orientation, this->position, this->orientation);
 	// reset flags
@@ -840,9 +977,18 @@ void ServerGameObject::setIndexedItem(int item, int index, float value)
 	// I don't think there is use by the client for indexed items, so no need to send a packet for now
 }
 
+bool ServerGameObject::isDisabledInHierarchy() const
+{
+	for (const ServerGameObject* obj = this; obj; obj = obj->getParent())
+		if (obj->disableCount > 0)
+			return true;
+	return false;
+}
+
 void ServerGameObject::startTrajectory(const Vector3& initPos, const Vector3& initVel, float startTime)
 {
 	trajectory.start(initPos, initVel, startTime);
+	Server::instance->activeObjects[Server::ACTIVE_TRAJECTORY].add(this);
 	NetPacketWriter npw{ NETCLIMSG_OBJECT_TRAJECTORY_STARTED };
 	npw.writeValues(this->id, initPos, initVel, startTime);
 	Server::instance->sendToAll(npw);
@@ -851,7 +997,7 @@ void ServerGameObject::startTrajectory(const Vector3& initPos, const Vector3& in
 void ServerGameObject::playSoundAtObject(int soundTag, ServerGameObject* target)
 {
 	NetPacketWriter npw{ NETCLIMSG_SOUND_AT_OBJECT };
-	uint8_t randval = (uint8_t)rand() & 255;
+	uint8_t randval = (uint8_t)(Server::instance->random.next() & 255);
 	npw.writeValues(this->id, soundTag, target->id, randval);
 	if (target->blueprint->bpClass == Tags::GAMEOBJCLASS_PLAYER)
 		Server::instance->sendTo(target, npw);
@@ -862,7 +1008,7 @@ void ServerGameObject::playSoundAtObject(int soundTag, ServerGameObject* target)
 void ServerGameObject::playSoundAtPosition(int soundTag, const Vector3& target)
 {
 	NetPacketWriter npw{ NETCLIMSG_SOUND_AT_POSITION };
-	uint8_t randval = (uint8_t)rand() & 255;
+	uint8_t randval = (uint8_t)(Server::instance->random.next() & 255);
 	npw.writeValues(this->id, soundTag, target, randval);
 	Server::instance->sendToAll(npw);
 }
@@ -989,19 +1135,22 @@ void ServerGameObject::updatePosition(const Vector3 & newposition, bool events)
 			newtileIndex = -1;
 		if (newtileIndex != tileIndex) {
 			int prevtileIndex = tileIndex;
-			tileIndex = newtileIndex;
-			if (prevtileIndex != -1) {
-				auto &vec = server->tiles[prevtileIndex].objList;
-				vec.erase(std::find(vec.begin(), vec.end(), this->id));
-			}
-			if (newtileIndex != -1) {
-				server->tiles[newtileIndex].objList.push_back(this->id);
-				if (events) {
-					for (auto& no : server->tiles[newtileIndex].objList) {
-						if (ServerGameObject* nobj = no.getFrom<Server>())
-							nobj->sendEvent(Tags::PDEVENT_ON_SHARE_TILE, this);
-					}
+			server->moveToTile(this, newtileIndex);
+			server->updateVisibility(this);
+			if (newtileIndex != -1 && events) {
+				// The reactions can move objects in or out of the tile, reordering its list,
+				// so the objects present now are copied first. The copy is appended to a buffer
+				// shared with the nested calls, and read by index as they can make it grow.
+				std::vector<uint32_t>& recipients = server->shareTileRecipients;
+				const size_t first = recipients.size();
+				for (const auto& ref : server->tiles[newtileIndex].objList)
+					recipients.push_back(ref.objid);
+				const size_t last = recipients.size();
+				for (size_t i = first; i < last; i++) {
+					if (ServerGameObject* nobj = server->findObject(recipients[i]))
+						nobj->sendEvent(Tags::PDEVENT_ON_SHARE_TILE, this);
 				}
+				recipients.resize(first);
 			}
 			if (events && prevtileIndex != -1 && newtileIndex != -1 && blueprint->bpClass == Tags::GAMEOBJCLASS_CHARACTER) {
 				if (server->tiles[prevtileIndex].zone != server->tiles[newtileIndex].zone) {
@@ -1013,39 +1162,79 @@ void ServerGameObject::updatePosition(const Vector3 & newposition, bool events)
 			}
 			updateOccupiedTiles(oldposition, orientation, newposition, orientation);
 		}
+		else if (tileIndex != -1 && newposition != oldposition) {
+			server->markTileChanged(tileIndex);
+		}
 	}
 }
 
 void ServerGameObject::lookForSightRangeEvents()
 {
-	if (!blueprint->receiveSightRangeEvents)
+	float radius = prepareSightRangeCheck();
+	if (radius < 0.0f)
 		return;
+	// the vectors are swapped between the objects and this buffer, so that they get reused
+	static std::vector<uint32_t> buffer;
+	std::vector<uint32_t> found = std::move(buffer);
+	querySightRange(radius, found);
+	sendSightRangeEvents(found);
+	buffer = std::move(found);
+}
+
+float ServerGameObject::prepareSightRangeCheck()
+{
+	if (!blueprint->receiveSightRangeEvents)
+		return -1.0f;
 	if (blueprint->sightRangeEquation == -1) {
 		printf("receiveSightRangeEvents==true but sightRangeEquation not defined\n%s\n", blueprint->getFullName().c_str());
-		return;
+		return -1.0f;
 	}
 	SrvScriptContext ctx{ Server::instance, this };
 	if (blueprint->shouldProcessSightRange && !blueprint->shouldProcessSightRange->booleval(&ctx))
-		return;
+		return -1.0f;
 	float dist = Server::instance->gameSet->equations[blueprint->sightRangeEquation]->eval(&ctx);
 	if (dist <= 0.0f)
-		return;
-	std::unordered_set<SrvGORef> objfound;
-	NNSearch search;
-	search.start(Server::instance, this->position, dist * 5.0f);
-	while (ServerGameObject* nobj = (ServerGameObject*)search.next()) {
-		if (!nobj->blueprint->generateSightRangeEvents)
-			continue;
-		objfound.insert(nobj);
-		if (seenObjects.count(nobj) == 0) {
-			this->sendEvent(Tags::PDEVENT_ON_SEEING_OBJECT, nobj);
-		}
+		return -1.0f;
+	Server* server = Server::instance;
+	const float radius = dist * 5.0f;
+	// nothing to do if the observer and everything around it didn't move since the last check
+	if (radius == sightCheckRadius && position == sightCheckPosition && !server->tilesChangedSince(sightCheckStamp, position, radius))
+		return -1.0f;
+	sightCheckRadius = radius;
+	sightCheckPosition = position;
+	sightCheckStamp = server->tileChangeCounter;
+	return radius;
+}
+
+void ServerGameObject::querySightRange(float radius, std::vector<uint32_t>& found) const
+{
+	found.clear();
+	NNCircleSearch::forEach(Server::instance, position, radius, [&found](CommonGameObject* obj) {
+		if (obj->blueprint->generateSightRangeEvents)
+			found.push_back(obj->id);
+	});
+	std::sort(found.begin(), found.end());
+}
+
+void ServerGameObject::sendSightRangeEvents(std::vector<uint32_t>& found)
+{
+	Server* server = Server::instance;
+	std::swap(seenObjects, found);
+	const std::vector<uint32_t>& previous = found;
+
+	// events sent in ID order, first for the new objects, then for the ones that are not seen anymore
+	for (size_t i = 0, j = 0; i < seenObjects.size(); i++) {
+		while (j < previous.size() && previous[j] < seenObjects[i]) j++;
+		if (j == previous.size() || previous[j] != seenObjects[i])
+			if (ServerGameObject* nobj = server->findObject(seenObjects[i]))
+				this->sendEvent(Tags::PDEVENT_ON_SEEING_OBJECT, nobj);
+	}
+	for (size_t i = 0, j = 0; i < previous.size(); i++) {
+		while (j < seenObjects.size() && seenObjects[j] < previous[i]) j++;
+		if (j == seenObjects.size() || seenObjects[j] != previous[i])
+			if (ServerGameObject* nobj = server->findObject(previous[i]))
+				this->sendEvent(Tags::PDEVENT_ON_STOP_SEEING_OBJECT, nobj);
 	}
-	for (auto& prevSeenObj : seenObjects)
-		if (prevSeenObj)
-			if (objfound.count(prevSeenObj) == 0)
-				this->sendEvent(Tags::PDEVENT_ON_STOP_SEEING_OBJECT, prevSeenObj);
-	seenObjects = std::move(objfound);
 }
 
 void ServerGameObject::addZoneTile(int tx, int tz)
@@ -1178,8 +1367,7 @@ void Server::syncTime()
 void Server::setDiplomaticStatus(ServerGameObject * a, ServerGameObject * b, int status)
 {
 	if (getDiplomaticStatus(a, b) != status) {
-		int &ref = (a->id <= b->id) ? diplomaticStatuses[{ a->id, b->id }] : diplomaticStatuses[{ b->id, a->id }];
-		ref = status;
+		storeDiplomaticStatus(a, b, status);
 		NetPacketWriter msg{ NETCLIMSG_DIPLOMATIC_STATUS_SET };
 		msg.writeUint32(a->id);
 		msg.writeUint32(b->id);
@@ -1352,71 +1540,96 @@ void Server::removeClient(NetLink* link)
 
 void Server::tick()
 {
+	// the events of a tick are committed once its outermost zone has ended, so at the beginning of the next tick
+	TICKPROF_END_TICK(tickProfiler);
+	TICKPROF_ZONE(tickProfiler, "Server::tick");
 	timeManager.tick();
+	applyPathResults();
 
-	auto it = delayedSequences.begin();
-	for (; it != delayedSequences.end(); it++) {
-		if (it->first > timeManager.currentTime) {
-			break;
-		}
-		DelayedSequence &ds = it->second;
-		for (SrvGORef &obj : ds.selfs) {
-			if (obj) {
-				SrvScriptContext ctx(this, obj);
-				ds.actionSequence->run(&ctx);
+	{
+		TICKPROF_ZONE(tickProfiler, "delayed sequences");
+		auto it = delayedSequences.begin();
+		for (; it != delayedSequences.end(); it++) {
+			if (it->first > timeManager.psCurrentTime) {
+				break;
 			}
-		}
-	}
-	delayedSequences.erase(delayedSequences.begin(), it);
-
-	for (size_t i = 0; i < overPeriodSequences.size(); i++) {
-		OverPeriodSequence& ops = overPeriodSequences[i];
-		int predictedExec = static_cast<int>((timeManager.currentTime - ops.startTime) * ops.numTotalExecutions / ops.period);
-		if (predictedExec > ops.numTotalExecutions) predictedExec = ops.numTotalExecutions;
-		SrvScriptContext ctx(this);
-		auto _ = ctx.change(ctx.sequenceExecutor, ops.executor);
-		for (; ops.numExecutionsDone < predictedExec; ops.numExecutionsDone++) {
-			if (ServerGameObject* obj = ops.remainingObjects.back().get()) {
-				auto _2 = ctx.changeSelf(obj);
-				ops.actionSequence->run(&ctx);
+			DelayedSequence &ds = it->second;
+			for (SrvGORef &obj : ds.selfs) {
+				if (obj) {
+					SrvScriptContext ctx(this, obj);
+					ds.actionSequence->run(&ctx);
+				}
 			}
-			ops.remainingObjects.pop_back();
-		}
-		if (ops.numExecutionsDone >= ops.numTotalExecutions) {
-			std::swap(ops, overPeriodSequences.back());
-			overPeriodSequences.pop_back();
-			i--;
 		}
+		delayedSequences.erase(delayedSequences.begin(), it);
 	}
-	for (size_t i = 0; i < repeatOverPeriodSequences.size(); i++) {
-		OverPeriodSequence& ops = repeatOverPeriodSequences[i];
-		int predictedExec = static_cast<int>((timeManager.currentTime - ops.startTime) * ops.numTotalExecutions / ops.period);
-		if (predictedExec > ops.numTotalExecutions) predictedExec = ops.numTotalExecutions;
-		SrvScriptContext ctx(this);
-		auto _ = ctx.change(ctx.sequenceExecutor, ops.executor);
-		for (; ops.numExecutionsDone < predictedExec; ops.numExecutionsDone++) {
-			for (auto& ref : ops.remainingObjects) {
-				if (ServerGameObject* obj = ref.get()) {
+
+	{
+		TICKPROF_ZONE(tickProfiler, "over-period sequences");
+		for (size_t i = 0; i < overPeriodSequences.size(); i++) {
+			OverPeriodSequence& ops = overPeriodSequences[i];
+			int predictedExec = static_cast<int>((timeManager.currentTime - ops.startTime) * ops.numTotalExecutions / ops.period);
+			if (predictedExec > ops.numTotalExecutions) predictedExec = ops.numTotalExecutions;
+			SrvScriptContext ctx(this);
+			auto _ = ctx.change(ctx.sequenceExecutor, ops.executor);
+			for (; ops.numExecutionsDone < predictedExec; ops.numExecutionsDone++) {
+				if (ServerGameObject* obj = ops.remainingObjects.back().get()) {
 					auto _2 = ctx.changeSelf(obj);
 					ops.actionSequence->run(&ctx);
 				}
+				ops.remainingObjects.pop_back();
+			}
+			if (ops.numExecutionsDone >= ops.numTotalExecutions) {
+				std::swap(ops, overPeriodSequences.back());
+				overPeriodSequences.pop_back();
+				i--;
 			}
 		}
-		if (ops.numExecutionsDone >= ops.numTotalExecutions) {
-			std::swap(ops, repeatOverPeriodSequences.back());
-			repeatOverPeriodSequences.pop_back();
-			i--;
+		for (size_t i = 0; i < repeatOverPeriodSequences.size(); i++) {
+			OverPeriodSequence& ops = repeatOverPeriodSequences[i];
+			int predictedExec = static_cast<int>((timeManager.currentTime - ops.startTime) * ops.numTotalExecutions / ops.period);
+			if (predictedExec > ops.numTotalExecutions) predictedExec = ops.numTotalExecutions;
+			SrvScriptContext ctx(this);
+			auto _ = ctx.change(ctx.sequenceExecutor, ops.executor);
+			for (; ops.numExecutionsDone < predictedExec; ops.numExecutionsDone++) {
+				for (auto& ref : ops.remainingObjects) {
+					if (ServerGameObject* obj = ref.get()) {
+						auto _2 = ctx.changeSelf(obj);
+						ops.actionSequence->run(&ctx);
+					}
+				}
+			}
+			if (ops.numExecutionsDone >= ops.numTotalExecutions) {
+				std::swap(ops, repeatOverPeriodSequences.back());
+				repeatOverPeriodSequences.pop_back();
+				i--;
+			}
 		}
 	}
 
-	static std::vector<SrvGORef> toprocess;
-	toprocess.clear();
-	const auto processObjOrders = [this](ServerGameObject *obj, auto &func) -> void {
-		if (obj->disableCount > 0)
-			return;
-		if (!obj->orderConfig.orders.empty() || obj->blueprint->receiveSightRangeEvents || obj->blueprint->removeWhenNotReferenced)
-			toprocess.emplace_back(obj);
-		if (obj->blueprint->bpClass == Tags::GAMEOBJCLASS_ARMY) {
+	// Every phase only goes through the objects that need it, see ActiveObjectList
+	{
+		TICKPROF_ZONE(tickProfiler, "players, armies, formations");
+		activeObjects[ACTIVE_PLAYER].update([this](ServerGameObject* obj) {
+			if (obj->blueprint->bpClass != Tags::GAMEOBJCLASS_PLAYER)
+				return false;
+			if (obj->isDisabledInHierarchy())
+				return true;
+			obj->aiController.update();
+			// Update "Number of Farmers" item (important for Food Consumption to work properly)
+			static const std::string numFarmersName = "Number of Farmers";
+			int numFarmersFinder = gameSet->objectFinderDefinitions.names.getIndex(numFarmersName);
+			if (numFarmersFinder != -1) {
+				SrvScriptContext ctx(this, obj);
+				obj->setItem(Tags::PDITEM_NUMBER_OF_FARMERS, gameSet->objectFinderDefinitions[numFarmersFinder]->eval(&ctx).size());
+			}
+			return true;
+		});
+		activeObjects[ACTIVE_ARMY].update([](ServerGameObject* obj) {
+			if (obj->blueprint->bpClass != Tags::GAMEOBJCLASS_ARMY)
+				return false;
+			if (obj->isDisabledInHierarchy())
+				return true;
 			Vector3 avg(0,0,0);
 			size_t cnt = 0;
 			for (auto& childtype : obj->children) {
@@ -1429,37 +1642,39 @@ void Server::tick()
 				avg /= (float)cnt;
 				obj->updatePosition(avg, false);
 			}
-		}
-		if (obj->blueprint->bpClass == Tags::GAMEOBJCLASS_PLAYER) {
-			obj->aiController.update();
-			// Update "Number of Farmers" item (important for Food Consumption to work properly)
-			static const std::string numFarmersName = "Number of Farmers";
-			int numFarmersFinder = gameSet->objectFinderDefinitions.names.getIndex(numFarmersName);
-			if (numFarmersFinder != -1) {
-				SrvScriptContext ctx(this, obj);
-				obj->setItem(Tags::PDITEM_NUMBER_OF_FARMERS, gameSet->objectFinderDefinitions[numFarmersFinder]->eval(&ctx).size());
-			}
-		}
-		if (obj->blueprint->bpClass == Tags::GAMEOBJCLASS_FORMATION) {
-			obj->formationController.update();
-		}
-		for (auto &childtype : obj->children) {
-			for (CommonGameObject* child : childtype.second)
-				func((ServerGameObject*)child, func);
-		}
-	};
-	if(getLevel())
-		processObjOrders(getLevel(), processObjOrders);
-	for (const SrvGORef& ref : toprocess) {
-		ServerGameObject* obj = ref.get();
-		if (!obj) continue;
-		obj->orderConfig.process();
-		if (!ref) continue;
-		if (obj->movement.isMoving()) {
+			return true;
+		});
+		activeObjects[ACTIVE_FORMATION].update([](ServerGameObject* obj) {
+			if (obj->blueprint->bpClass != Tags::GAMEOBJCLASS_FORMATION)
+				return false;
+			if (!obj->isDisabledInHierarchy())
+				obj->formationController.update();
+			return true;
+		});
+	}
+
+	{
+		TICKPROF_ZONE(tickProfiler, "orderConfig.process");
+		activeObjects[ACTIVE_ORDERS].update([](ServerGameObject* obj) {
+			if (!obj->isDisabledInHierarchy())
+				obj->orderConfig.process();
+			// one more process when the last order is removed, to send the ON_IDLE event
+			return !obj->orderConfig.orders.empty() || obj->orderConfig.busy;
+		});
+	}
+
+	{
+		TICKPROF_ZONE(tickProfiler, "movement");
+		activeObjects[ACTIVE_MOVEMENT].update([this](ServerGameObject* obj) {
+			if (!obj->movement.isMoving())
+				return false;
+			if (obj->isDisabledInHierarchy())
+				return true;
+			SrvGORef ref = obj;
 			auto newpos = obj->movement.getNewPosition(timeManager.currentTime);
 			newpos.y = terrain->getHeightEx(obj->position.x, obj->position.z, obj->blueprint->canWalkOnWater());
 			obj->updatePosition(newpos, true);
-			if (!ref) continue;
+			if (!ref) return false;
 			Vector3 dir = obj->movement.getDirection();
 			obj->orientation.y = atan2f(dir.x, -dir.z);
 			// restart movement is speed changes
@@ -1469,17 +1684,85 @@ void Server::tick()
 			}
 			// pf
 			obj->movementController.updateMovement();
+			return obj->movement.isMoving();
+		});
+	}
+
+	{
+		TICKPROF_ZONE(tickProfiler, "trajectories");
+		activeObjects[ACTIVE_TRAJECTORY].update([this](ServerGameObject* obj) {
+			if (!obj->trajectory.isMoving())
+				return false;
+			if (!obj->isDisabledInHierarchy() && !obj->movement.isMoving()) {
+				obj->updatePosition(obj->trajectory.getPosition(timeManager.currentTime));
+				obj->orientation = obj->trajectory.getRotationAngles(timeManager.currentTime);
+			}
+			return true;
+		});
+	}
+
+	{
+		TICKPROF_ZONE(tickProfiler, "lookForSightRangeEvents");
+		static std::vector<ServerGameObject*> urgent, due;
+		urgent.clear();
+		due.clear();
+		activeObjects[ACTIVE_SIGHT_RANGE].update([this](ServerGameObject* obj) {
+			if (!obj->blueprint->receiveSightRangeEvents)
+				return false;
+			if (obj->isDisabledInHierarchy())
+				return true;
+			const bool moving = obj->movement.isMoving();
+			int period = sightCheckPeriods[obj->blueprint->bpClass];
+			if (moving)
+				period = (period + 1) / 2;
+			if (!obj->sightCheckPending && (obj->id + timeManager.numTicks) % (uint64_t)period != 0)
+				return true;
+			// without budget, no need to reorder
+			if (sightCheckBudget != 0 && (obj->sightCheckPending || moving))
+				urgent.push_back(obj);
+			else
+				due.push_back(obj);
+			return true;
+		});
+		// The sight ranges are evaluated by scripts, so on this thread
+		static std::vector<std::pair<ServerGameObject*, float>> checks;
+		checks.clear();
+		size_t budget = (sightCheckBudget != 0) ? (size_t)sightCheckBudget : SIZE_MAX;
+		for (auto* list : { &urgent, &due }) {
+			for (ServerGameObject* obj : *list) {
+				obj->sightCheckPending = (budget == 0);
+				if (budget != 0) {
+					float radius = obj->prepareSightRangeCheck();
+					if (radius >= 0.0f)
+						checks.emplace_back(obj, radius);
+					budget--;
+				}
+			}
 		}
-		else if (obj->trajectory.isMoving()) {
-			obj->updatePosition(obj->trajectory.getPosition(timeManager.currentTime));
-			obj->orientation = obj->trajectory.getRotationAngles(timeManager.currentTime);
-		}
-		if (obj->blueprint->receiveSightRangeEvents) {
-			obj->lookForSightRangeEvents();
-			if (!ref) continue;
-		}
-		if (obj->blueprint->removeWhenNotReferenced)
-			obj->removeIfNotReferenced();
+		// The urgent objects were taken first, but the events are sent in object ID order
+		std::sort(checks.begin(), checks.end(), [](const auto& a, const auto& b) { return a.first->id < b.first->id; });
+		// The queries only read the tiles and objects, which don't change until the events are sent
+		static std::vector<std::vector<uint32_t>> results;
+		if (results.size() < checks.size())
+			results.resize(checks.size());
+		JobSystem::instance().parallelFor(0, checks.size(), 16, [](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+				checks[i].first->querySightRange(checks[i].second, results[i]);
+		});
+		// The events are sent in the order of the checks, whatever the number of threads
+		for (size_t i = 0; i < checks.size(); i++)
+			checks[i].first->sendSightRangeEvents(results[i]);
+	}
+
+	{
+		TICKPROF_ZONE(tickProfiler, "removeIfNotReferenced");
+		activeObjects[ACTIVE_REMOVE_UNREFERENCED].update([](ServerGameObject* obj) {
+			if (!obj->blueprint->removeWhenNotReferenced)
+				return false;
+			if (!obj->isDisabledInHierarchy())
+				obj->removeIfNotReferenced();
+			return true;
+		});
 	}
 
 	time_t curtime = time(NULL);
@@ -1488,176 +1771,283 @@ void Server::tick()
 		syncTime();
 	}
 
-	int clientIndex = -1;
-	for (NetLink *cli : clientLinks) {
-		ServerGameObject* player = clientPlayerObjects[++clientIndex];
-		int pcnt = 20;
-		while (cli->available() && (pcnt--)) { // DDoS !!!
-			NetPacket packet = cli->receive();
-			BinaryReader br(packet.data.c_str());
-			uint8_t type = br.readUint8();
-
-			switch (type) {
-			case NETSRVMSG_TEST: {
-				std::string msg = br.readStringZ();
-				chatMessages.push_back(msg);
-				printf("Server got message: %s\n", msg.c_str());
-
-				if (msg.size() >= 2 && msg[0] == '!') {
-					GSFileParser gsf = GSFileParser(msg.c_str() + 1);
-					Action* act = ReadAction(gsf, *gameSet);
-					SrvScriptContext ctx(this, player);
-					act->run(&ctx);
-					delete act;
-				}
+	{
+		TICKPROF_ZONE(tickProfiler, "packet handling");
+		int clientIndex = -1;
+		for (NetLink *cli : clientLinks) {
+			ServerGameObject* player = clientPlayerObjects[++clientIndex];
+			int pcnt = 20;
+			while (cli->available() && (pcnt--)) { // DDoS !!!
+				NetPacket packet = cli->receive();
+				BinaryReader br(packet.data.c_str());
+				uint8_t type = br.readUint8();
+
+				switch (type) {
+				case NETSRVMSG_TEST: {
+					std::string msg = br.readStringZ();
+					chatMessages.push_back(msg);
+					printf("Server got message: %s\n", msg.c_str());
+
+					if (msg.size() >= 2 && msg[0] == '!') {
+						GSFileParser gsf = GSFileParser(msg.c_str() + 1);
+						Action* act = ReadAction(gsf, *gameSet);
+						SrvScriptContext ctx(this, player);
+						act->run(&ctx);
+						delete act;
+					}
 
-				NetPacketWriter echo(NETCLIMSG_TEST);
-				echo.writeStringZ(msg);
-				sendToAll(echo);
-				break;
-			}
-			case NETSRVMSG_COMMAND: {
-				int cmdid = br.readUint32();
-				int objid = br.readUint32();
-				int mode = br.readUint8();
-				int targetid = br.readUint32();
-				Vector3 destination = br.readVector3();
-				gameSet->commands[cmdid].execute(findObject(objid), findObject(targetid), mode, destination);
-				break;
-			}
-			case NETSRVMSG_PAUSE: {
-				uint8_t newPaused = br.readUint8();
-				if (newPaused)
-					timeManager.pause();
-				else
-					timeManager.unpause();
-				syncTime();
-				break;
-			}
-			case NETSRVMSG_STAMPDOWN: {
-				const uint32_t bpid = br.readUint32();
-				const uint32_t playerid = br.readUint32();
-				const Vector3 pos = br.readVector3();
-				const uint8_t flags = br.readUint8();
-				const bool sendEvent = flags & 1;
-				const bool inGameplay = flags & 2;
-
-				clientInfos[clientIndex].lastStampdown = nullptr;
-
-				const GameObjBlueprint* blueprint = gameSet->getBlueprint(bpid);
-				ServerGameObject* owningPlayer = findObject(playerid);
-				if (!blueprint || !owningPlayer)
+					NetPacketWriter echo(NETCLIMSG_TEST);
+					echo.writeStringZ(msg);
+					sendToAll(echo);
+					break;
+				}
+				case NETSRVMSG_COMMAND: {
+					int cmdid = br.readUint32();
+					int objid = br.readUint32();
+					int mode = br.readUint8();
+					int targetid = br.readUint32();
+					Vector3 destination = br.readVector3();
+					gameSet->commands[cmdid].execute(findObject(objid), findObject(targetid), mode, destination);
+					break;
+				}
+				case NETSRVMSG_PAUSE: {
+					uint8_t newPaused = br.readUint8();
+					if (newPaused)
+						timeManager.pause();
+					else
+						timeManager.unpause();
+					syncTime();
 					break;
+				}
+				case NETSRVMSG_STAMPDOWN: {
+					const uint32_t bpid = br.readUint32();
+					const uint32_t playerid = br.readUint32();
+					const Vector3 pos = br.readVector3();
+					const uint8_t flags = br.readUint8();
+					const bool sendEvent = flags & 1;
+					const bool inGameplay = flags & 2;
 
-				ServerGameObject* obj = stampdownObject(blueprint, owningPlayer, pos, Vector3(0.0f, 0.0f, 0.0f), sendEvent, inGameplay);
+					clientInfos[clientIndex].lastStampdown = nullptr;
 
-				clientInfos[clientIndex].lastStampdown = obj;
-				break;
-			}
-			case NETSRVMSG_START_LEVEL: {
-				startLevel();
-				break;
-			}
-			case NETSRVMSG_GAME_TEXT_WINDOW_BUTTON_CLICKED: {
-				int gtwid = br.readUint32();
-				int button = br.readUint32();
-				SrvScriptContext ctx(this, player);
-				gameSet->gameTextWindows[gtwid].buttons[button].onClickSequence.run(&ctx); // TODO: Correct player object
-				break;
-			}
-			case NETSRVMSG_CAMERA_PATH_ENDED: {
-				int camPathIndex = br.readUint32();
-				SrvScriptContext ctx(this, player);
-				gameSet->cameraPaths[camPathIndex].postPlaySequence.run(&ctx);
-				break;
-			}
-			case NETSRVMSG_CHANGE_GAME_SPEED: {
-				setGameSpeed(br.readFloat());
-				break;
-			}
-			case NETSRVMSG_MUSIC_COMPLETED: {
-				player->isMusicPlaying = false;
-				break;
-			}
-			case NETSRVMSG_TERMINATE_OBJECT: {
-				if (ServerGameObject* obj = findObject(br.readUint32())) {
-					deleteObject(obj);
+					const GameObjBlueprint* blueprint = gameSet->getBlueprint(bpid);
+					ServerGameObject* owningPlayer = findObject(playerid);
+					if (!blueprint || !owningPlayer)
+						break;
+
+					ServerGameObject* obj = stampdownObject(blueprint, owningPlayer, pos, Vector3(0.0f, 0.0f, 0.0f), sendEvent, inGameplay);
+
+					clientInfos[clientIndex].lastStampdown = obj;
+					break;
 				}
-				break;
-			}
-			case NETSRVMSG_BUILD_LAST_STAMPDOWNED_OBJECT: {
-				uint32_t objid = br.readUint32();
-				if (ServerGameObject* obj = findObject(objid)) {
-					int assignmentMode = br.readUint32();
-					int cmdid = gameSet->commands.names.getIndex("Build");
-					gameSet->commands[cmdid].execute(obj, clientInfos[clientIndex].lastStampdown, assignmentMode);
+				case NETSRVMSG_START_LEVEL: {
+					startLevel();
+					break;
 				}
-				break;
-			}
-			case NETSRVMSG_CANCEL_COMMAND: {
-				auto [objectId, commandId] = br.readValues<uint32_t, int>();
-				if (ServerGameObject* obj = findObject(objectId)) {
-					OrderBlueprint* orderBp = gameSet->commands[commandId].order;
-					for (Order& order : obj->orderConfig.orders) {
-						if (order.blueprint == orderBp && !order.isDone()) {
-							order.cancel();
-							break;
+				case NETSRVMSG_GAME_TEXT_WINDOW_BUTTON_CLICKED: {
+					int gtwid = br.readUint32();
+					int button = br.readUint32();
+					SrvScriptContext ctx(this, player);
+					gameSet->gameTextWindows[gtwid].buttons[button].onClickSequence.run(&ctx); // TODO: Correct player object
+					break;
+				}
+				case NETSRVMSG_CAMERA_PATH_ENDED: {
+					int camPathIndex = br.readUint32();
+					SrvScriptContext ctx(this, player);
+					gameSet->cameraPaths[camPathIndex].postPlaySequence.run(&ctx);
+					break;
+				}
+				case NETSRVMSG_CHANGE_GAME_SPEED: {
+					setGameSpeed(br.readFloat());
+					break;
+				}
+				case NETSRVMSG_MUSIC_COMPLETED: {
+					player->isMusicPlaying = false;
+					break;
+				}
+				case NETSRVMSG_TERMINATE_OBJECT: {
+					if (ServerGameObject* obj = findObject(br.readUint32())) {
+						deleteObject(obj);
+					}
+					break;
+				}
+				case NETSRVMSG_BUILD_LAST_STAMPDOWNED_OBJECT: {
+					uint32_t objid = br.readUint32();
+					if (ServerGameObject* obj = findObject(objid)) {
+						int assignmentMode = br.readUint32();
+						int cmdid = gameSet->commands.names.getIndex("Build");
+						gameSet->commands[cmdid].execute(obj, clientInfos[clientIndex].lastStampdown, assignmentMode);
+					}
+					break;
+				}
+				case NETSRVMSG_CANCEL_COMMAND: {
+					auto [objectId, commandId] = br.readValues<uint32_t, int>();
+					if (ServerGameObject* obj = findObject(objectId)) {
+						OrderBlueprint* orderBp = gameSet->commands[commandId].order;
+						for (Order& order : obj->orderConfig.orders) {
+							if (order.blueprint == orderBp && !order.isDone()) {
+								order.cancel();
+								break;
+							}
 						}
 					}
+					break;
 				}
-				break;
-			}
-			case NETSRVMSG_PUT_UNIT_INTO_NEW_FORMATION: {
-				uint32_t objId = br.readUint32();
-				clientInfos[clientIndex].unitsForNewFormation.push_back(objId);
-				break;
-			}
-			case NETSRVMSG_CREATE_NEW_FORMATION: {
-				const GameObjBlueprint* blueprint = &gameSet->objBlueprints[Tags::GAMEOBJCLASS_FORMATION][0];
-				ServerGameObject* formation = spawnObject(blueprint, player, {}, {});
-				Vector3 positionSum; int numUnits = 0;
-				for (ServerGameObject* sub : clientInfos[clientIndex].unitsForNewFormation) {
-					positionSum += sub->position;
-					numUnits += 1;
-					sub->setParent(formation);
+				case NETSRVMSG_PUT_UNIT_INTO_NEW_FORMATION: {
+					uint32_t objId = br.readUint32();
+					clientInfos[clientIndex].unitsForNewFormation.push_back(objId);
+					break;
 				}
-				formation->setPosition(positionSum / numUnits);
-				formation->sendEvent(Tags::PDEVENT_ON_SPAWN);
-				clientInfos[clientIndex].unitsForNewFormation.clear();
-				break;
-			}
-			case NETSRVMSG_SET_BUILDING_SPAWNED_UNIT_ORDER_TO_TARGET: {
-				auto [objectId, commandIndex, targetId] = br.readValues<uint32_t, uint32_t, uint32_t>();
-				ServerGameObject* obj = findObject(objectId);
-				const Command* command = gameSet->commands.getPointer(commandIndex);
-				ServerGameObject* target = findObject(targetId);
-				if (!(obj && command))
+				case NETSRVMSG_CREATE_NEW_FORMATION: {
+					const GameObjBlueprint* blueprint = &gameSet->objBlueprints[Tags::GAMEOBJCLASS_FORMATION][0];
+					ServerGameObject* formation = spawnObject(blueprint, player, {}, {});
+					Vector3 positionSum; int numUnits = 0;
+					for (ServerGameObject* sub : clientInfos[clientIndex].unitsForNewFormation) {
+						positionSum += sub->position;
+						numUnits += 1;
+						sub->setParent(formation);
+					}
+					formation->setPosition(positionSum / numUnits);
+					formation->sendEvent(Tags::PDEVENT_ON_SPAWN);
+					clientInfos[clientIndex].unitsForNewFormation.clear();
 					break;
-				obj->setBuildingSpawnedUnitOrderToTarget(commandIndex, target);
-				break;
-			}
-			case NETSRVMSG_SET_BUILDING_SPAWNED_UNIT_ORDER_TO_DESTINATION: {
-				auto [objectId, commandIndex, destination, faceTo] = br.readValues<uint32_t, uint32_t, Vector3, Vector3>();
-				ServerGameObject* obj = findObject(objectId);
-				const Command* command = gameSet->commands.getPointer(commandIndex);
-				if (!(obj && command))
+				}
+				case NETSRVMSG_SET_BUILDING_SPAWNED_UNIT_ORDER_TO_TARGET: {
+					auto [objectId, commandIndex, targetId] = br.readValues<uint32_t, uint32_t, uint32_t>();
+					ServerGameObject* obj = findObject(objectId);
+					const Command* command = gameSet->commands.getPointer(commandIndex);
+					ServerGameObject* target = findObject(targetId);
+					if (!(obj && command))
+						break;
+					obj->setBuildingSpawnedUnitOrderToTarget(commandIndex, target);
 					break;
-				obj->setBuildingSpawnedUnitOrderToDestination(commandIndex, destination, faceTo);
-				break;
-			}
+				}
+				case NETSRVMSG_SET_BUILDING_SPAWNED_UNIT_ORDER_TO_DESTINATION: {
+					auto [objectId, commandIndex, destination, faceTo] = br.readValues<uint32_t, uint32_t, Vector3, Vector3>();
+					ServerGameObject* obj = findObject(objectId);
+					const Command* command = gameSet->commands.getPointer(commandIndex);
+					if (!(obj && command))
+						break;
+					obj->setBuildingSpawnedUnitOrderToDestination(commandIndex, destination, faceTo);
+					break;
+				}
+				}
 			}
 		}
+
 	}
 
 	// Free up deleted objects
-	auto* obj = objToDelete;
-	while (obj) {
-		auto* next = obj->nextDeleted;
-		destroyObject(obj);
-		obj = next;
+	{
+		TICKPROF_ZONE(tickProfiler, "deferred deletion");
+		auto* obj = objToDelete;
+		while (obj) {
+			auto* next = obj->nextDeleted;
+			destroyObject(obj);
+			obj = next;
+		}
+		objToDelete = nullptr;
+		objToDeleteLast = nullptr;
 	}
-	objToDelete = nullptr;
-	objToDeleteLast = nullptr;
+
+	startPathRequests();
 
 	++g_diag_serverTicks;
 }
+
+uint32_t Server::requestPath(ServerGameObject* object, MovementClass movementClass, Pathfinding::PFPos start, Pathfinding::PFPos end)
+{
+	PathRequest& request = pendingPathRequests.emplace_back();
+	if (++pathRequestCounter == 0) // 0 is for no request
+		++pathRequestCounter;
+	request.sequence = pathRequestCounter;
+	request.object = object;
+	request.movementClass = movementClass;
+	request.start = start;
+	request.end = end;
+	return request.sequence;
+}
+
+void Server::startPathRequests()
+{
+	if (pendingPathRequests.empty())
+		return;
+	TICKPROF_ZONE(tickProfiler, "start path requests");
+	// the previous requests were applied at the beginning of the tick, so no job reads the pathfinders anymore
+	assert(runningPathRequests.empty());
+	bool used[NUM_MOVEMENT_CLASSES] = {};
+	for (const PathRequest& request : pendingPathRequests)
+		used[request.movementClass] = true;
+	for (int mc = 0; mc < NUM_MOVEMENT_CLASSES; mc++)
+		if (used[mc])
+			pathfinders[mc].update(this, (MovementClass)mc);
+	std::swap(runningPathRequests, pendingPathRequests);
+
+	// the flow fields must be used with the passability they were computed with
+	const game_time_t now = timeManager.currentTime;
+	flowFields.erase(std::remove_if(flowFields.begin(), flowFields.end(), [this, now](const CachedFlowField& cached) {
+		return cached.passabilityVersion != pathfinders[cached.movementClass].getUpdatedAt() || now - cached.lastUse > FLOW_FIELD_LIFETIME;
+	}), flowFields.end());
+	std::map<std::tuple<int, int, int>, size_t> numRequestsToTile;
+	for (const PathRequest& request : runningPathRequests)
+		numRequestsToTile[{ request.movementClass, request.end.x, request.end.z }]++;
+	// the requests solved by every flow field, in request order
+	std::vector<std::vector<PathRequest*>> flowFieldRequests(flowFields.size());
+	std::vector<PathRequest*> otherRequests;
+	for (PathRequest& request : runningPathRequests) {
+		auto it = std::find_if(flowFields.begin(), flowFields.end(), [&request](const CachedFlowField& cached) {
+			return cached.movementClass == request.movementClass && cached.field->getDestination() == request.end;
+		});
+		if (it == flowFields.end()) {
+			if (flowFieldMinUnits == 0 || numRequestsToTile[{ request.movementClass, request.end.x, request.end.z }] < (size_t)flowFieldMinUnits) {
+				otherRequests.push_back(&request);
+				continue;
+			}
+			const HierarchicalPathfinder& pathfinder = pathfinders[request.movementClass];
+			flowFields.push_back({ request.movementClass, pathfinder.getUpdatedAt(), now, std::make_unique<FlowField>(&pathfinder, request.end) });
+			flowFieldRequests.emplace_back();
+			it = flowFields.end() - 1;
+		}
+		it->lastUse = now;
+		flowFieldRequests[it - flowFields.begin()].push_back(&request);
+	}
+
+	// the vectors are left as is until all the jobs are done
+	JobSystem& jobSystem = JobSystem::instance();
+	for (size_t i = 0; i < flowFields.size(); i++) {
+		if (flowFieldRequests[i].empty())
+			continue;
+		// the requests of a field are solved by the same job, as they extend the same search
+		jobSystem.run([field = flowFields[i].field.get(), requests = std::move(flowFieldRequests[i])]() {
+			for (PathRequest* request : requests)
+				request->result = field->getPath(request->start);
+		}, &pathJobs);
+	}
+	for (PathRequest* request : otherRequests)
+		jobSystem.run([this, request]() {
+			request->result = pathfinders[request->movementClass].findPath(request->start, request->end);
+		}, &pathJobs);
+}
+
+void Server::applyPathResults()
+{
+	if (runningPathRequests.empty())
+		return;
+	TICKPROF_ZONE(tickProfiler, "apply path results");
+	JobSystem::instance().wait(pathJobs);
+	for (PathRequest& request : runningPathRequests) {
+		// the unit might have been removed, stopped or given another destination since the request
+		ServerGameObject* obj = request.object;
+		if (obj && obj->movementController.m_pathRequest == request.sequence)
+			obj->movementController.applyPath(request.result);
+	}
+	runningPathRequests.clear();
+}
+
+void Server::cancelPathRequests()
+{
+	if (!runningPathRequests.empty())
+		JobSystem::instance().wait(pathJobs);
+	runningPathRequests.clear();
+	pendingPathRequests.clear();
+	flowFields.clear();
+}
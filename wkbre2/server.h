@@ -6,9 +6,11 @@
 
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <vector>
 #include "common.h"
 #include "TimeManager.h"
+#include "TickProfiler.h"
 #include "Order.h"
 #include "GameObjectRef.h"
 #include <unordered_set>
@@ -17,6 +19,11 @@
 #include "MovementController.h"
 #include "AIController.h"
 #include "FormationController.h"
+#include "util/ObjectPool.h"
+#include "VisibilityGrid.h"
+#include "HierarchicalPathfinder.h"
+#include "JobSystem.h"
+#include "FlowField.h"
 
 struct GameSet;
 struct GSFileParser;
@@ -33,12 +40,19 @@ struct ServerGameObject : SpecificGameObject<Server, ServerGameObject> {
 	using Program = Server;
 
 	bool deleted = false; ServerGameObject* nextDeleted = nullptr;
+	uint8_t activeListFlags = 0; // bit i set if in Server::activeObjects[i]
 
 	OrderConfiguration orderConfig;
 	std::unordered_set<const Reaction*> individualReactions;
 	std::unordered_map<int, std::unordered_set<SrvGORef>> associates, associators;
 	std::vector<SrvGORef> referencers;
-	std::unordered_set<SrvGORef> seenObjects;
+	std::vector<uint32_t> seenObjects; // IDs of the objects seen at the last sight range check, sorted
+	// Where the last sight range check was made, to skip the next ones while nothing changes around
+	Vector3 sightCheckPosition;
+	float sightCheckRadius = -1.0f;
+	uint64_t sightCheckStamp = 0;
+	bool sightCheckPending = false; // due but postponed because of the budget
+	VisibilityGrid::Stamp sightStamp; // what the object adds to Server::visibility
 	std::set<std::pair<int, int>> zoneTiles;
 	int clientIndex = -1;
 	bool isMusicPlaying = false;
@@ -88,6 +102,13 @@ struct ServerGameObject : SpecificGameObject<Server, ServerGameObject> {
 
 	void updatePosition(const Vector3 &newposition, bool events = false);
 	void lookForSightRangeEvents();
+	// lookForSightRangeEvents in 3 steps, so that the queries of many objects can run in parallel:
+	// prepareSightRangeCheck evaluates the sight range (-1 if no check needed),
+	// querySightRange finds the objects in sight (only reads the objects and tiles),
+	// and sendSightRangeEvents compares them with the previous ones and sends the events.
+	float prepareSightRangeCheck();
+	void querySightRange(float radius, std::vector<uint32_t>& found) const;
+	void sendSightRangeEvents(std::vector<uint32_t>& found);
 	void addZoneTile(int tx, int tz);
 	//void removeZoneTile(int tx, int tz);
 	void updateSightRange();
@@ -96,11 +117,45 @@ struct ServerGameObject : SpecificGameObject<Server, ServerGameObject> {
 	float computeSpeed();
 	void notifySubordinateRemoved();
 
+	bool isDisabledInHierarchy() const;
 	bool canAffordObject(const GameObjBlueprint* blueprint);
 	void payObjectCost(const GameObjBlueprint* blueprint);
 	void reclaimObjectCost(const GameObjBlueprint* blueprint);
 };
 
+// List of the objects that need some update every tick, in the order they were added.
+// Objects are added when they may need the update, and only removed by update()
+// once they are found not to need it anymore (or are deleted).
+struct ActiveObjectList {
+	std::vector<SrvGORef> objects;
+	uint8_t flag = 0; // bit in ServerGameObject::activeListFlags
+
+	void add(ServerGameObject* obj) {
+		if (!(obj->activeListFlags & flag)) {
+			obj->activeListFlags |= flag;
+			objects.push_back(obj);
+		}
+	}
+
+	// Calls func(obj) on every object of the list, and removes it from the list if it returns false.
+	// The objects added during the update will only be updated the next time.
+	template <typename Func> void update(Func func) {
+		const size_t count = objects.size();
+		size_t kept = 0;
+		for (size_t i = 0; i < count; i++) {
+			const SrvGORef ref = objects[i]; // copy, func might add objects to the vector
+			ServerGameObject* obj = ref.get();
+			if (!obj)
+				continue;
+			if (func(obj))
+				objects[kept++] = ref;
+			else
+				obj->activeListFlags &= ~flag;
+		}
+		objects.erase(objects.begin() + kept, objects.begin() + count);
+	}
+};
+
 struct Server : SpecificGameState<ServerGameObject, ProgramType::SERVER>
 {
 	using GameObject = ServerGameObject;
@@ -108,9 +163,10 @@ struct Server : SpecificGameState<ServerGameObject, ProgramType::SERVER>
 
 	//GameSet *gameSet;
 
-	uint32_t randomSeed;
+	uint32_t randomSeed; // seed of the simulation random generator when a new level is loaded
 	TimeManager timeManager;
-	uint32_t nextUniqueId;
+	TickProfiler tickProfiler;
+	ObjectPool<ServerGameObject> objectPool;
 
 	//ServerGameObject *level;
 	//std::map<uint32_t, ServerGameObject*> idmap;
@@ -127,7 +183,7 @@ struct Server : SpecificGameState<ServerGameObject, ProgramType::SERVER>
 		int numTotalExecutions, numExecutionsDone;
 		std::vector<SrvGORef> remainingObjects;
 	};
-	std::multimap<game_time_t, DelayedSequence> delayedSequences;
+	std::multimap<uint32_t, DelayedSequence> delayedSequences; // key is time in milliseconds
 	std::vector<OverPeriodSequence> overPeriodSequences;
 	std::vector<OverPeriodSequence> repeatOverPeriodSequences;
 
@@ -148,9 +204,69 @@ struct Server : SpecificGameState<ServerGameObject, ProgramType::SERVER>
 
 	ServerGameObject* objToDelete = nullptr, * objToDeleteLast = nullptr;
 
-	Server() { instance = this; }
+	// Objects of a tile that get ON_SHARE_TILE from an object entering it, see ServerGameObject::updatePosition
+	std::vector<uint32_t> shareTileRecipients;
+
+	// Objects processed by the tick, so that it doesn't need to walk the whole object tree
+	enum ActiveList {
+		ACTIVE_ORDERS = 0,
+		ACTIVE_MOVEMENT,
+		ACTIVE_TRAJECTORY,
+		ACTIVE_SIGHT_RANGE,
+		ACTIVE_REMOVE_UNREFERENCED,
+		ACTIVE_PLAYER,
+		ACTIVE_ARMY,
+		ACTIVE_FORMATION,
+		NUM_ACTIVE_LISTS
+	};
+	ActiveObjectList activeObjects[NUM_ACTIVE_LISTS];
+
+	// Sight range checks of the objects of a class are done every sightCheckPeriods[class] ticks
+	// (twice as often when moving), staggered by object ID, with at most sightCheckBudget checks
+	// per tick (0 = no limit). The postponed and moving objects are checked first.
+	// The phase is timeManager.numTicks, so that it only depends on the game time of a loaded savegame.
+	int sightCheckPeriods[Tags::GAMEOBJCLASS_COUNT];
+	int sightCheckBudget = 0;
+
+	VisibilityGrid visibility;
+	HierarchicalPathfinder pathfinders[NUM_MOVEMENT_CLASSES]; // built the first time a unit looks for a path
+
+	// The paths requested by the movement controllers during a tick are searched on the worker threads
+	// after the tick, with the passability as it was at its end, and given to the units at the beginning
+	// of the next tick in the order of the requests, so the result doesn't depend on the number of threads.
+	struct PathRequest {
+		uint32_t sequence; // MovementController::m_pathRequest of the unit when requested
+		SrvGORef object;
+		MovementClass movementClass;
+		Pathfinding::PFPos start, end;
+		std::vector<Pathfinding::PFPos> result;
+	};
+	std::vector<PathRequest> pendingPathRequests; // requested during the current tick
+	std::vector<PathRequest> runningPathRequests; // being searched since the end of the previous tick
+	JobCounter pathJobs;
+	uint32_t pathRequestCounter = 0;
+
+	// When at least flowFieldMinUnits units (0 = never) ask for a path to the same tile in a tick, a flow field
+	// from this tile is computed once and gives the paths of all of them, instead of a search for every unit.
+	// The field is kept for the next requests to the tile until not used for FLOW_FIELD_LIFETIME seconds
+	// or until the passability changes.
+	static constexpr float FLOW_FIELD_LIFETIME = 10.0f;
+	struct CachedFlowField {
+		MovementClass movementClass;
+		uint64_t passabilityVersion; // HierarchicalPathfinder::getUpdatedAt() of the pathfinder when created
+		game_time_t lastUse;
+		std::unique_ptr<FlowField> field;
+	};
+	std::vector<CachedFlowField> flowFields;
+	int flowFieldMinUnits = 8;
+
+	Server();
+	~Server();
 
 	void loadSaveGame(const char *filename);
+	// True if the last loaded savegame was saved during a match, not at the start of a level.
+	// The savegames don't store it, so it comes from the game time, which is 0 when a level starts.
+	bool isLoadedMidMatch() const { return timeManager.currentTime > 0.0f; }
 	ServerGameObject *createObject(const GameObjBlueprint *blueprint, uint32_t id = 0);
 	ServerGameObject* spawnObject(const GameObjBlueprint* blueprint, ServerGameObject* parent, const Vector3& initialPosition, const Vector3& initialOrientation);
 	ServerGameObject* stampdownObject(const GameObjBlueprint* blueprint, ServerGameObject* player, const Vector3& position, const Vector3& orientation,
@@ -158,6 +274,13 @@ struct Server : SpecificGameState<ServerGameObject, ProgramType::SERVER>
 	void deleteObject(ServerGameObject *obj);
 	void destroyObject(ServerGameObject* obj);
 
+	// Queues a path search, returns its sequence number
+	uint32_t requestPath(ServerGameObject* object, MovementClass movementClass, Pathfinding::PFPos start, Pathfinding::PFPos end);
+	void startPathRequests();
+	void applyPathResults();
+	// Waits for the running path searches and drops all the requests without applying them
+	void cancelPathRequests();
+
 	//ServerGameObject* findObject(uint32_t id) { auto it = idmap.find(id); return (it != idmap.end()) ? it->second : nullptr; }
 
 	void addClient(NetLink* link);
@@ -188,11 +311,15 @@ struct Server : SpecificGameState<ServerGameObject, ProgramType::SERVER>
 
 	void tick();
 
+	// Updates the tiles seen by the player of the object after it moved, changed sight range, player, or disappeared
+	void updateVisibility(ServerGameObject* obj);
+
 private:
 	std::map<uint32_t, const GameObjBlueprint*> predec;
 
 	ServerGameObject * loadObject(GSFileParser & gsf, const std::string & clsname);
 	void loadSavePredec(GSFileParser & gsf);
+	void activateFromBlueprint(ServerGameObject* obj);
 
 	void sendToAll(const NetPacket &packet);
 	void sendToAll(const NetPacketWriter &packet);
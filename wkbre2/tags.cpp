@@ -422,7 +422,7 @@ TagDict<6> Tags::OBJCREATE_tagDict({
     "TYPE_TO_CREATE",
 });
 
-TagDict<15> Tags::SAVEGAME_tagDict({
+TagDict<16> Tags::SAVEGAME_tagDict({
     "CLIENT_STATE",
     "DELAYED_SEQUENCE_EXECUTION",
     "EXECUTE_SEQUENCE_OVER_PERIOD",
@@ -434,6 +434,7 @@ TagDict<15> Tags::SAVEGAME_tagDict({
     "NUM_HUMAN_PLAYERS",
     "PART_OF_CAMPAIGN",
     "PREDEC",
+    "RANDOM_STATE",
     "REPEAT_SEQUENCE_OVER_PERIOD",
     "SERVER_NAME",
     "TIME_MANAGER_STATE",
@@ -439,12 +439,13 @@ const int SAVEGAME_NEXT_UPDATE_TIME_STAMP = 7;
 const int SAVEGAME_NUM_HUMAN_PLAYERS = 8;
 const int SAVEGAME_PART_OF_CAMPAIGN = 9;
 const int SAVEGAME_PREDEC = 10;
-const int SAVEGAME_REPEAT_SEQUENCE_OVER_PERIOD = 11;
-const int SAVEGAME_SERVER_NAME = 12;
-const int SAVEGAME_TIME_MANAGER_STATE = 13;
-const int SAVEGAME_UPDATE_ID = 14;
-const int SAVEGAME_COUNT = 15;
-extern TagDict<15> SAVEGAME_tagDict;
+const int SAVEGAME_RANDOM_STATE = 11;
+const int SAVEGAME_REPEAT_SEQUENCE_OVER_PERIOD = 12;
+const int SAVEGAME_SERVER_NAME = 13;
+const int SAVEGAME_TIME_MANAGER_STATE = 14;
+const int SAVEGAME_UPDATE_ID = 15;
+const int SAVEGAME_COUNT = 16;
+extern TagDict<16> SAVEGAME_tagDict;
 
 const int GAMEOBJ_AI_CONTROLLER = 0;
 const int GAMEOBJ_ALIAS = 1;
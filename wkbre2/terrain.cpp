@@ -77,6 +77,10 @@ Vector3 Terrain::getNormal(int x, int z) const {
 void Terrain::createEmpty(int newWidth, int newHeight) {
 	width = newWidth; height = newHeight; edge = 0;
 	scale = 1.0f;
+	// flat and dry
+	vertices.resize((width + 1) * (height + 1));
+	std::fill(vertices.data(), vertices.data() + vertices.size(), 0);
+	tiles = new Tile[width * height]();
 	fogColor = 0x9FC5E6;
 	sunColor = -1;
 	sunVector = Vector3(1, 1, 1);
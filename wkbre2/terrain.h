@@ -79,6 +79,7 @@ struct Terrain
 	void freeArrays() {
 		vertices.resize(0);
 		if (tiles) delete[] tiles;
+		tiles = nullptr;
 	}
 
 	void createEmpty(int newWidth, int newHeight);
@@ -42,6 +42,12 @@
 #include "ParticleSystem.h"
 #include "gfx/DefaultParticleRenderer.h"
 #include "ParticleContainer.h"
+#include "JobSystem.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
 
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
@@ -525,6 +531,50 @@ void Test_Network()
 	srvThread.join();
 }
 
+void Test_ObjectIds()
+{
+	// the IDs of the objects created at runtime must be the ones given to the client
+	static constexpr int NUM_OBJECTS = 1000;
+	Server server;
+	NetLocalBuffer toClient, fromClient;
+	NetLocalLink link(&fromClient, &toClient);
+	server.addClient(&link);
+	GameObjBlueprint blueprint;
+	blueprint.bpClass = Tags::GAMEOBJCLASS_CHARACTER;
+	std::vector<uint32_t> serverIds;
+	for (int i = 0; i < NUM_OBJECTS; i++) {
+		ServerGameObject* obj = server.createObject(&blueprint);
+		serverIds.push_back(obj->id);
+		// free some IDs, so that slots are reused with a new generation
+		if (i % 3 == 2) {
+			server.idmap.erase(obj->id);
+			server.objectPool.destroy(obj);
+		}
+	}
+	std::vector<uint32_t> clientIds;
+	while (!toClient.queue.empty()) {
+		NetPacket packet = toClient.queue.front();
+		toClient.queue.pop();
+		BinaryReader br(packet.data.c_str());
+		if (br.readUint8() == NETCLIMSG_OBJECT_CREATED)
+			clientIds.push_back(br.readUint32());
+	}
+	std::vector<uint32_t> sortedIds = serverIds;
+	std::sort(sortedIds.begin(), sortedIds.end());
+	int numFailed = 0;
+	if (clientIds != serverIds) {
+		printf("FAIL: the IDs sent to the client differ from the server ones\n");
+		numFailed++;
+	}
+	if (sortedIds.front() == 0 || std::adjacent_find(sortedIds.begin(), sortedIds.end()) != sortedIds.end()) {
+		printf("FAIL: null or duplicate object IDs\n");
+		numFailed++;
+	}
+	printf("%i check(s) failed\n", numFailed);
+	server.removeClient(&link);
+	getchar();
+}
+
 void Test_EnetServer() {
 	LoadBCP("data.bcp");
 	Server server;
@@ -777,31 +827,215 @@ void Test_SoundPlayer() {
 	getchar();
 }
 
+namespace {
+	using TestClock = std::chrono::steady_clock;
+	double MsSince(TestClock::time_point start) { return std::chrono::duration<double, std::milli>(TestClock::now() - start).count(); }
+
+	// Pseudo-random numbers in [0, n), the same on every platform
+	struct TestRandom {
+		uint32_t seed;
+		int operator()(int n) { seed = seed * 1664525u + 1013904223u; return (int)((seed >> 8) % (uint32_t)n); }
+	};
+
+	// Calls block(x, z) for the tiles of numWalls random horizontal and vertical walls on a size x size map
+	template<typename Block> void AddRandomWalls(TestRandom& rand, int size, int numWalls, Block block) {
+		for (int i = 0; i < numWalls; i++) {
+			int x = rand(size), z = rand(size), len = 5 + rand(30);
+			bool vertical = rand(2) != 0;
+			for (int k = 0; k < len; k++) {
+				int tx = vertical ? x : x + k, tz = vertical ? z + k : z;
+				if (tx < size && tz < size)
+					block(tx, tz);
+			}
+		}
+	}
+
+	// Cost of the path, -1 if it is not a valid path
+	template<typename Predicate> int PathCost(const std::vector<Pathfinding::PFPos>& path, Predicate pred) {
+		int cost = 0;
+		for (size_t i = 0; i < path.size(); i++) {
+			if (pred(path[i]))
+				return -1;
+			if (i > 0) {
+				int dx = std::abs(path[i].x - path[i - 1].x), dz = std::abs(path[i].z - path[i - 1].z);
+				if (dx > 1 || dz > 1 || dx + dz == 0)
+					return -1;
+				cost += (dx + dz == 2) ? 141 : 100;
+			}
+		}
+		return cost;
+	}
+
+	// The A* before the flat arrays, with the open and closed sets in hash maps, for comparison
+	struct LegacyAStarPathfinder {
+		using PFPos = Pathfinding::PFPos;
+		using score_t = int;
+		using pfp_set = std::unordered_set<PFPos, PFPos::Hasher>;
+		template<typename T> using pfp_map = std::unordered_map<PFPos, T, PFPos::Hasher>;
+		std::vector<std::pair<PFPos, score_t>> nextTiles;
+		pfp_set visited;
+		pfp_map<int> scores;
+		pfp_map<PFPos> edges;
+		PFPos start, end;
+		bool finished = false;
+		bool nothingFound = false;
+
+		void begin(PFPos start, PFPos end) {
+			visited.clear();
+			scores.clear();
+			edges.clear();
+			this->start = start;
+			this->end = end;
+			finished = false;
+			nothingFound = false;
+			scores[start] = 0;
+			nextTiles = { {start, 0} };
+		}
+
+		template<typename Predicate, typename Heuristic>
+		bool next(Predicate pred, Heuristic heuristic) {
+			if (finished) return true;
+			static auto heapcmp = [](const auto& a, const auto& b) {return a.second > b.second; };
+			PFPos mt;
+			score_t mscore = std::numeric_limits<score_t>::max();
+			while (!nextTiles.empty()) {
+				std::tie(mt, mscore) = nextTiles.front();
+				std::pop_heap(nextTiles.begin(), nextTiles.end(), heapcmp);
+				nextTiles.pop_back();
+				if (!visited.count(mt))
+					break;
+			}
+			if (mscore == std::numeric_limits<score_t>::max()) {
+				finished = true;
+				nothingFound = true;
+				return true;
+			}
+			if (mt == end) {
+				finished = true;
+				nothingFound = false;
+				return true;
+			}
+			auto updateNeighbour = [this, mt, &pred, &heuristic](int dx, int dz, score_t cost) {
+				PFPos pfp{ mt.x + dx, mt.z + dz };
+				if (!pred(pfp)) {
+					score_t newscore = scores.at(mt) + cost;
+					if (!scores.count(pfp) || newscore < scores.at(pfp)) {
+						scores[pfp] = newscore;
+						edges[pfp] = mt;
+						if (!visited.count(pfp)) {
+							nextTiles.emplace_back(pfp, newscore + heuristic(pfp, end));
+							std::push_heap(nextTiles.begin(), nextTiles.end(), heapcmp);
+						}
+					}
+				}
+			};
+			updateNeighbour(1, 0, 100);
+			updateNeighbour(-1, 0, 100);
+			updateNeighbour(0, 1, 100);
+			updateNeighbour(0, -1, 100);
+			updateNeighbour(1, 1, 141);
+			updateNeighbour(-1, 1, 141);
+			updateNeighbour(1, -1, 141);
+			updateNeighbour(-1, -1, 141);
+			visited.insert(mt);
+			return false;
+		}
+
+		std::vector<PFPos> get() {
+			if (nothingFound)
+				return {};
+			std::vector<PFPos> vec;
+			PFPos pfp = end;
+			while (pfp != start) {
+				vec.push_back(pfp);
+				pfp = edges.at(pfp);
+			}
+			vec.push_back(start);
+			return vec;
+		}
+	};
+
+	template<typename Predicate, typename Heuristic>
+	std::vector<Pathfinding::PFPos> LegacyDoPathfinding(Pathfinding::PFPos start, Pathfinding::PFPos end, Predicate pred, Heuristic heuristic) {
+		LegacyAStarPathfinder astar1, astar2;
+		astar1.begin(start, end);
+		astar2.begin(end, start);
+		while (true) {
+			if (astar1.next(pred, heuristic)) return astar1.get();
+			if (astar2.next(pred, heuristic)) {
+				auto vec = astar2.get();
+				std::reverse(vec.begin(), vec.end());
+				return vec;
+			}
+		}
+	}
+}
+
 void Test_Pathfinding()
 {
 	using namespace Pathfinding;
-	static constexpr int WIDTH = 1000, HEIGHT = 1000;
-	//static constexpr char map[HEIGHT][WIDTH] = {
-	//	{1,1,1,1,1,1,1,1,1,1},
-	//	{1,1,0,1,1,1,1,1,1,1},
-	//	{1,0,0,1,1,1,1,1,1,1},
-	//	{1,1,0,0,0,0,0,1,1,1},
-	//	{1,1,1,1,0,1,1,1,1,1},
-	//	{1,0,0,0,0,1,1,1,1,1},
-	//	{1,1,0,1,1,1,1,1,1,1},
-	//	{1,1,0,1,1,1,1,1,1,1},
-	//	{1,1,0,1,1,1,1,1,1,1},
-	//	{1,1,1,1,1,1,1,1,1,1}
-	//};
-	auto pred = [](PFPos pos) -> bool {
-		if (pos.x >= 0 && pos.x < WIDTH && pos.z >= 0 && pos.z < HEIGHT)
-			return false; //return map[pos.z][pos.x] != 0;
+	static constexpr int SIZE = 256, NUM_QUERIES = 200;
+	TestRandom rand{ 1234 };
+
+	// Maze: cells on the odd coordinates, carved with a depth-first walk,
+	// then some walls are removed so that there are several ways around
+	std::vector<char> blocked(SIZE * SIZE, 1);
+	std::vector<PFPos> stack = { {1, 1} };
+	blocked[1 * SIZE + 1] = 0;
+	while (!stack.empty()) {
+		PFPos cell = stack.back();
+		static const PFPos dirs[4] = { {2, 0}, {-2, 0}, {0, 2}, {0, -2} };
+		PFPos options[4];
+		int numOptions = 0;
+		for (const PFPos& d : dirs) {
+			PFPos n{ cell.x + d.x, cell.z + d.z };
+			if (n.x > 0 && n.x < SIZE - 1 && n.z > 0 && n.z < SIZE - 1 && blocked[n.z * SIZE + n.x])
+				options[numOptions++] = n;
+		}
+		if (numOptions == 0) {
+			stack.pop_back();
+			continue;
+		}
+		PFPos n = options[rand(numOptions)];
+		blocked[((cell.z + n.z) / 2) * SIZE + (cell.x + n.x) / 2] = 0;
+		blocked[n.z * SIZE + n.x] = 0;
+		stack.push_back(n);
+	}
+	for (int i = 0; i < SIZE * SIZE / 20; i++) {
+		int x = 1 + rand(SIZE - 2), z = 1 + rand(SIZE - 2);
+		if ((x + z) % 2 == 1)
+			blocked[z * SIZE + x] = 0;
+	}
+	auto pred = [&blocked](PFPos pos) -> bool {
+		if (pos.x >= 0 && pos.x < SIZE && pos.z >= 0 && pos.z < SIZE)
+			return blocked[pos.z * SIZE + pos.x] != 0;
 		return true;
 	};
-	auto vec = DoPathfinding({ 2,2 }, { 800,900 }, pred, ManhattanDiagHeuristic);
-	printf("Results:\n");
-	for (const PFPos& pfp : vec)
-		printf("(%i, %i)\n", pfp.x, pfp.z);
+
+	std::vector<std::pair<PFPos, PFPos>> queries;
+	while (queries.size() < NUM_QUERIES) {
+		PFPos a{ rand(SIZE), rand(SIZE) }, b{ rand(SIZE), rand(SIZE) };
+		if (!pred(a) && !pred(b))
+			queries.emplace_back(a, b);
+	}
+	const auto pathCost = [&pred](const std::vector<PFPos>& path) { return PathCost(path, pred); };
+
+	std::vector<int> legacyCosts, costs;
+	auto start = TestClock::now();
+	for (const auto& [a, b] : queries)
+		legacyCosts.push_back(pathCost(LegacyDoPathfinding(a, b, pred, ManhattanDiagHeuristic)));
+	printf("hash maps:     %8.3f ms for %i paths\n", MsSince(start), NUM_QUERIES);
+	start = TestClock::now();
+	for (const auto& [a, b] : queries)
+		costs.push_back(pathCost(DoPathfinding(a, b, SIZE, SIZE, pred, ManhattanDiagHeuristic)));
+	printf("flat arrays:   %8.3f ms for %i paths\n", MsSince(start), NUM_QUERIES);
+
+	int numDifferent = 0, numInvalid = 0;
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		numDifferent += (costs[i] != legacyCosts[i]) ? 1 : 0;
+		numInvalid += (costs[i] == -1) ? 1 : 0;
+	}
+	printf("%s: %i path(s) with a different cost, %i invalid path(s)\n", (numDifferent == 0 && numInvalid == 0) ? "OK" : "FAIL", numDifferent, numInvalid);
 	getchar();
 }
 
@@ -944,6 +1178,309 @@ void Test_PFRayTraversal() {
 	getchar();
 }
 
+void Test_JobSystem()
+{
+	int numFailed = 0;
+	const auto check = [&numFailed](bool ok, const char* what) {
+		printf("%s: %s\n", ok ? "OK  " : "FAIL", what);
+		if (!ok) numFailed++;
+	};
+	for (int numThreads : { 0, 1, 3, (int)std::thread::hardware_concurrency() }) {
+		printf("===== %i worker thread(s)\n", numThreads);
+		JobSystem js(numThreads);
+
+		// every index visited exactly once
+		std::vector<std::atomic<int>> visits(100000);
+		js.parallelFor(0, visits.size(), 1000, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+				visits[i].fetch_add(1);
+		});
+		check(std::all_of(visits.begin(), visits.end(), [](const std::atomic<int>& v) { return v == 1; }), "parallelFor covers the range once");
+
+		// jobs starting jobs and waiting for them
+		std::atomic<int> leaves{ 0 };
+		JobCounter outer;
+		for (int i = 0; i < 16; i++) {
+			js.run([&js, &leaves]() {
+				JobCounter inner;
+				for (int j = 0; j < 16; j++)
+					js.run([&leaves]() { leaves++; }, &inner);
+				js.wait(inner);
+			}, &outer);
+		}
+		js.wait(outer);
+		check(leaves == 256, "nested jobs with wait-and-help");
+
+		// graph: a -> (b, c) -> d, d must see the results of b and c
+		std::atomic<int> step{ 0 };
+		int orderA = -1, orderB = -1, orderC = -1, orderD = -1;
+		JobGraph graph;
+		size_t a = graph.add([&]() { orderA = step++; });
+		size_t b = graph.add([&]() { orderB = step++; });
+		size_t c = graph.add([&]() { orderC = step++; });
+		size_t d = graph.add([&]() { orderD = step++; });
+		graph.addDependency(a, b);
+		graph.addDependency(a, c);
+		graph.addDependency(b, d);
+		graph.addDependency(c, d);
+		bool graphOk = true;
+		for (int run = 0; run < 100; run++) {
+			step = 0;
+			graph.run(js);
+			graphOk = graphOk && orderA == 0 && orderB > orderA && orderC > orderA && orderD == 3;
+		}
+		check(graphOk, "graph dependencies respected over 100 runs");
+	}
+
+	// Micro-benchmark
+	JobSystem& js = JobSystem::instance();
+	printf("===== Benchmark with %zu worker thread(s)\n", js.getNumWorkers());
+	std::vector<float> data(1 << 22);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = (float)i;
+	const auto work = [&data](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++)
+			data[i] = std::sqrt(data[i] * 1.0001f + 1.0f);
+	};
+	auto start = TestClock::now();
+	for (int i = 0; i < 10; i++)
+		work(0, data.size());
+	printf("serial loop:           %8.3f ms\n", MsSince(start));
+	start = TestClock::now();
+	for (int i = 0; i < 10; i++)
+		js.parallelFor(0, data.size(), 16384, work);
+	printf("parallelFor:           %8.3f ms\n", MsSince(start));
+	start = TestClock::now();
+	JobCounter counter;
+	for (int i = 0; i < 100000; i++)
+		js.run([]() {}, &counter);
+	js.wait(counter);
+	printf("100000 empty jobs:     %8.3f ms\n", MsSince(start));
+
+	printf("%i check(s) failed\n", numFailed);
+	getchar();
+}
+
+void Test_TileMembership()
+{
+	// 5000 units walking back and forth in a corridor of 20 tiles
+	static constexpr int NUM_UNITS = 5000, NUM_TILES = 20, NUM_STEPS = 200;
+	Server server;
+	Terrain terrain;
+	terrain.createEmpty(NUM_TILES, 1);
+	server.terrain = &terrain;
+	server.initTiles();
+	GameObjBlueprint blueprint;
+	blueprint.bpClass = Tags::GAMEOBJCLASS_CHARACTER;
+	blueprint.footprint = nullptr;
+	std::vector<ServerGameObject*> units;
+	for (int i = 0; i < NUM_UNITS; i++) {
+		ServerGameObject* obj = server.objectPool.create(0, &blueprint);
+		obj->id = server.idmap.allocate(obj);
+		obj->updatePosition(Vector3((i % NUM_TILES) * 5.0f + 2.5f, 0.0f, 2.5f), false);
+		units.push_back(obj);
+	}
+	const auto stepPosition = [](int unit, int step) {
+		float x = std::fmod((unit % NUM_TILES) * 5.0f + 2.5f + step * 1.3f, NUM_TILES * 5.0f);
+		return Vector3(x, 0.0f, 2.5f);
+	};
+
+	// what the tile lists did before: linear search and erase
+	std::vector<std::vector<uint32_t>> oldLists(NUM_TILES);
+	std::vector<int> oldTiles(NUM_UNITS);
+	for (int i = 0; i < NUM_UNITS; i++) {
+		oldTiles[i] = i % NUM_TILES;
+		oldLists[oldTiles[i]].push_back(units[i]->id);
+	}
+	auto start = TestClock::now();
+	for (int step = 1; step <= NUM_STEPS; step++) {
+		for (int i = 0; i < NUM_UNITS; i++) {
+			int tile = (int)(stepPosition(i, step).x / 5.0f);
+			if (tile != oldTiles[i]) {
+				auto& vec = oldLists[oldTiles[i]];
+				vec.erase(std::find(vec.begin(), vec.end(), units[i]->id));
+				oldLists[tile].push_back(units[i]->id);
+				oldTiles[i] = tile;
+			}
+		}
+	}
+	printf("find + erase:       %8.3f ms\n", MsSince(start));
+
+	start = TestClock::now();
+	for (int step = 1; step <= NUM_STEPS; step++)
+		for (int i = 0; i < NUM_UNITS; i++)
+			units[i]->updatePosition(stepPosition(i, step), false);
+	printf("updatePosition:     %8.3f ms\n", MsSince(start));
+
+	// check that the lists and the slots agree
+	bool ok = true;
+	size_t total = 0;
+	for (int t = 0; t < NUM_TILES; t++) {
+		const auto& vec = server.tiles[t].objList;
+		total += vec.size();
+		for (size_t s = 0; s < vec.size(); s++) {
+			ServerGameObject* obj = vec[s].getFrom<Server>();
+			ok = ok && obj && obj->tileIndex == t && obj->tileSlot == (int)s;
+		}
+	}
+	printf("%s: %zu objects in the tiles\n", (ok && total == NUM_UNITS) ? "OK" : "FAIL", total);
+	for (ServerGameObject* obj : units) {
+		server.moveToTile(obj, -1);
+		server.idmap.erase(obj->id);
+		server.objectPool.destroy(obj);
+	}
+	server.terrain = nullptr;
+	terrain.freeArrays();
+	getchar();
+}
+
+void Test_HierarchicalPathfinding()
+{
+	// 512x512 tiles with random walls, long paths with A* on the tiles and with HPA*
+	using namespace Pathfinding;
+	static constexpr int SIZE = 512, NUM_QUERIES = 100;
+	TestRandom rand{ 99 };
+	const auto mc = CommonGameState::MOVEMENT_LAND;
+
+	Server server;
+	Terrain terrain;
+	terrain.createEmpty(SIZE, SIZE);
+	server.terrain = &terrain;
+	server.initTiles();
+	auto block = [&server, mc](int tx, int tz, bool blocked = true) {
+		if (tx < SIZE && tz < SIZE) {
+			server.tileBlocked[mc].set(tz * SIZE + tx, blocked);
+			server.tileBlocks[1][(tz >> 4) * server.tileBlocksPerRow[1] + (tx >> 4)].lastPassabilityChange = ++server.passabilityChangeCounter;
+		}
+	};
+	AddRandomWalls(rand, SIZE, 1200, block);
+	auto pred = [&server, mc](PFPos pos) { return server.isTileBlocked(mc, pos.x, pos.z); };
+	std::vector<std::pair<PFPos, PFPos>> queries;
+	while (queries.size() < NUM_QUERIES) {
+		PFPos a{ rand(SIZE), rand(SIZE) }, b{ rand(SIZE), rand(SIZE) };
+		if (!pred(a) && !pred(b))
+			queries.emplace_back(a, b);
+	}
+	const auto pathCost = [&pred](const std::vector<PFPos>& path) { return PathCost(path, pred); };
+
+	HierarchicalPathfinder& hpa = server.pathfinders[mc];
+	auto start = TestClock::now();
+	hpa.update(&server, mc);
+	printf("cluster build: %8.3f ms, %zu entrances\n", MsSince(start), hpa.getNumEntrances());
+	std::vector<int> costs, hpaCosts;
+	start = TestClock::now();
+	for (const auto& [a, b] : queries)
+		costs.push_back(pathCost(DoPathfinding(a, b, SIZE, SIZE, pred, ManhattanDiagHeuristic)));
+	printf("A*:            %8.3f ms for %i paths\n", MsSince(start), NUM_QUERIES);
+	start = TestClock::now();
+	for (const auto& [a, b] : queries)
+		hpaCosts.push_back(pathCost(hpa.findPath(a, b)));
+	printf("HPA*:          %8.3f ms for %i paths\n", MsSince(start), NUM_QUERIES);
+
+	const auto compare = [&](const std::vector<int>& costs, const std::vector<int>& hpaCosts) {
+		int numInvalid = 0, numMissed = 0, numCompared = 0;
+		double totalRatio = 0.0;
+		for (size_t i = 0; i < costs.size(); i++) {
+			if (hpaCosts[i] == -1)
+				numInvalid++;
+			else if (costs[i] > 0 && hpaCosts[i] == 0)
+				numMissed++;
+			else if (costs[i] > 0) {
+				totalRatio += (double)hpaCosts[i] / costs[i];
+				numCompared++;
+			}
+		}
+		printf("HPA* paths are %.1f%% longer on average\n", numCompared ? (totalRatio / numCompared - 1.0) * 100.0 : 0.0);
+		printf("%s: %i invalid path(s), %i path(s) not found\n", (numInvalid == 0 && numMissed == 0) ? "OK" : "FAIL", numInvalid, numMissed);
+	};
+	compare(costs, hpaCosts);
+
+	// a new wall only rebuilds the clusters around it, the paths that went through it must go around
+	for (int z = 50; z < 460; z++)
+		block(200, z);
+	start = TestClock::now();
+	hpa.update(&server, mc);
+	printf("rebuild:       %8.3f ms\n", MsSince(start));
+	costs.clear();
+	hpaCosts.clear();
+	for (const auto& [a, b] : queries) {
+		if (pred(a) || pred(b))
+			continue;
+		costs.push_back(pathCost(DoPathfinding(a, b, SIZE, SIZE, pred, ManhattanDiagHeuristic)));
+		hpaCosts.push_back(pathCost(hpa.findPath(a, b)));
+	}
+	compare(costs, hpaCosts);
+
+	// a cluster whose only way out is diagonal through its corner has no entrance
+	for (int z = 0; z < 64; z++)
+		for (int x = 0; x < 64; x++)
+			block(x, z, (x == 16 && z < 16) || (z == 16 && x < 16));
+	hpa.update(&server, mc);
+	const int cornerCost = pathCost(hpa.findPath({ 2, 2 }, { 50, 50 }));
+	printf("%s: path through the corner of a cluster\n", (cornerCost > 0) ? "OK" : "FAIL");
+	server.terrain = nullptr;
+	terrain.freeArrays();
+	getchar();
+}
+
+void Test_FlowField()
+{
+	// 512x512 tiles with random walls, many units going to the same tile with A* and with one flow field
+	using namespace Pathfinding;
+	static constexpr int SIZE = 512, NUM_UNITS = 200;
+	TestRandom rand{ 1234 };
+	const auto mc = CommonGameState::MOVEMENT_LAND;
+
+	Server server;
+	Terrain terrain;
+	terrain.createEmpty(SIZE, SIZE);
+	server.terrain = &terrain;
+	server.initTiles();
+	AddRandomWalls(rand, SIZE, 1200, [&server, mc](int tx, int tz) { server.tileBlocked[mc].set(tz * SIZE + tx, true); });
+	server.passabilityChangeCounter++;
+	auto pred = [&server, mc](PFPos pos) { return server.isTileBlocked(mc, pos.x, pos.z); };
+	PFPos destination;
+	do {
+		destination = { rand(SIZE), rand(SIZE) };
+	} while (pred(destination));
+	// the army starts in a corner of the map, far from the destination
+	std::vector<PFPos> starts;
+	while (starts.size() < NUM_UNITS) {
+		PFPos pos{ rand(64), rand(64) };
+		if (!pred(pos))
+			starts.push_back(pos);
+	}
+	// cost of the path from end to start, -1 if it is not a valid path
+	const auto pathCost = [&pred](const std::vector<PFPos>& path, PFPos start, PFPos end) {
+		if (!path.empty() && !(path.front() == end && path.back() == start))
+			return -1;
+		return PathCost(path, pred);
+	};
+
+	std::vector<int> costs, fieldCosts;
+	auto start = TestClock::now();
+	for (const PFPos& pos : starts)
+		costs.push_back(pathCost(DoPathfinding(pos, destination, SIZE, SIZE, pred, ManhattanDiagHeuristic), pos, destination));
+	printf("A*:         %8.3f ms for %i units\n", MsSince(start), NUM_UNITS);
+	HierarchicalPathfinder& pathfinder = server.pathfinders[mc];
+	pathfinder.update(&server, mc);
+	start = TestClock::now();
+	FlowField field(&pathfinder, destination);
+	for (const PFPos& pos : starts)
+		fieldCosts.push_back(pathCost(field.getPath(pos), pos, destination));
+	printf("flow field: %8.3f ms for %i units, %zu tiles reached\n", MsSince(start), NUM_UNITS, field.getNumSettledTiles());
+
+	// the paths of the flow field are shortest paths too
+	int numDifferent = 0;
+	for (int i = 0; i < NUM_UNITS; i++)
+		if (costs[i] != fieldCosts[i])
+			numDifferent++;
+	printf("%s: %i path(s) with a different cost\n", (numDifferent == 0) ? "OK" : "FAIL", numDifferent);
+	server.terrain = nullptr;
+	terrain.freeArrays();
+	getchar();
+}
+
 const std::vector<std::pair<void(*)(), const char*> > testList = {
 {Test_GameSet, "Game set loading"},
 {Test_GSFileParser, "GSF Parser"},
@@ -956,6 +1493,7 @@ const std::vector<std::pair<void(*)(), const char*> > testList = {
 {Test_Terrain, "Terrain"},
 {Test_Mesh, "Mesh"},
 {Test_Network, "Network"},
+{Test_ObjectIds, "Object IDs"},
 {Test_EnetServer, "Enet Server"},
 {Test_EnetClient, "Enet Client"},
 {Test_Anim, "Anim"},
@@ -964,6 +1502,10 @@ const std::vector<std::pair<void(*)(), const char*> > testList = {
 {Test_Pathfinding, "Pathfinding"},
 {Test_ParticleSystem, "Particle system"},
 {Test_PFRayTraversal, "PF Ray Traversal"},
+{Test_JobSystem, "Job System"},
+{Test_TileMembership, "Tile membership"},
+{Test_HierarchicalPathfinding, "Hierarchical pathfinding"},
+{Test_FlowField, "Flow field"},
 };
 
 void LaunchTest()
@@ -0,0 +1,145 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <vector>
+
+// Maps object IDs to objects in constant time.
+// An ID is made of a slot index (low bits) and the generation of the slot (high bits).
+// When an object is removed, the generation of its slot is incremented before the slot
+// is reused, so old references to the removed object don't find the new one.
+// IDs given explicitly (from savegames or from the server) are put in their slot if possible,
+// otherwise they go in a small overflow map, so any 32-bit ID still works.
+template <typename T> class ObjectIdMap {
+public:
+	static constexpr uint32_t INDEX_BITS = 20;
+	static constexpr uint32_t INDEX_LIMIT = 1u << INDEX_BITS;
+	static constexpr uint32_t INDEX_MASK = INDEX_LIMIT - 1;
+	static constexpr uint32_t MAX_GENERATION = (1u << (31 - INDEX_BITS)) - 1; // IDs stay positive when read as int
+	static constexpr uint32_t RETIRED = MAX_GENERATION + 1; // generation of a slot that is not reused anymore
+
+	static constexpr uint32_t makeId(uint32_t index, uint32_t generation) { return index | (generation << INDEX_BITS); }
+
+	T* find(uint32_t id) const {
+		const uint32_t index = id & INDEX_MASK;
+		if (index < slots.size()) {
+			const Slot& slot = slots[index];
+			if (slot.object && slot.generation == (id >> INDEX_BITS))
+				return slot.object;
+		}
+		if (!overflow.empty()) {
+			auto it = overflow.find(id);
+			if (it != overflow.end())
+				return it->second;
+		}
+		return nullptr;
+	}
+
+	// Adds an object with a new ID and returns the ID
+	uint32_t allocate(T* object) {
+		while (!freeIndices.empty()) {
+			// an index can be in the queue more than once, or be taken by insert() in the meantime
+			const uint32_t index = freeIndices.front();
+			freeIndices.pop_front();
+			Slot& slot = slots[index];
+			if (!slot.object && slot.generation != RETIRED)
+				return take(index, slot.generation, object);
+		}
+		if (nextIndex < INDEX_LIMIT)
+			return take(nextIndex++, 0, object);
+		// All indices were given, look for one that is free but not in the queue (left free by a savegame)
+		for (uint32_t i = 1; i < (uint32_t)slots.size(); i++) {
+			Slot& slot = slots[scanCursor];
+			const uint32_t index = scanCursor;
+			scanCursor = (scanCursor + 1 < slots.size()) ? scanCursor + 1 : 1;
+			if (!slot.object && slot.generation < MAX_GENERATION)
+				return take(index, slot.generation + 1, object);
+		}
+		return 0;
+	}
+
+	// Adds an object with the given ID. Returns false if the ID is already used.
+	bool insert(uint32_t id, T* object) {
+		if (find(id))
+			return false;
+		const uint32_t index = id & INDEX_MASK;
+		const uint32_t generation = id >> INDEX_BITS;
+		if (index != 0 && generation <= MAX_GENERATION) {
+			if (index >= slots.size())
+				slots.resize(std::max<size_t>(index + 1, slots.size() * 2));
+			if (!slots[index].object) {
+				take(index, generation, object);
+				nextIndex = std::max(nextIndex, index + 1);
+				return true;
+			}
+		}
+		overflow[id] = object;
+		return true;
+	}
+
+	void erase(uint32_t id) {
+		const uint32_t index = id & INDEX_MASK;
+		if (index < slots.size()) {
+			Slot& slot = slots[index];
+			if (slot.object && slot.generation == (id >> INDEX_BITS)) {
+				slot.object = nullptr;
+				numObjects--;
+				if (slot.generation < MAX_GENERATION) {
+					slot.generation++;
+					freeIndices.push_back(index);
+				}
+				else {
+					slot.generation = RETIRED;
+				}
+				return;
+			}
+		}
+		numObjects -= overflow.erase(id);
+	}
+
+	// The new IDs will not use the slot indices below the given one
+	// (e.g. the indices of the objects that were deleted before the savegame was made)
+	void reserveIndicesBelow(uint32_t index) {
+		nextIndex = std::max(nextIndex, std::min(index, INDEX_LIMIT));
+	}
+
+	void clear() {
+		slots.assign(1, Slot());
+		freeIndices.clear();
+		overflow.clear();
+		nextIndex = 1;
+		scanCursor = 1;
+		numObjects = 0;
+	}
+
+	size_t size() const { return numObjects; }
+
+	ObjectIdMap() { clear(); }
+
+private:
+	struct Slot {
+		T* object = nullptr;
+		uint32_t generation = 0;
+	};
+	std::vector<Slot> slots; // slot 0 is never used, as ID 0 means no object
+	std::deque<uint32_t> freeIndices; // FIFO, so the generations of the slots grow slowly
+	std::map<uint32_t, T*> overflow;
+	uint32_t nextIndex = 1;
+	uint32_t scanCursor = 1;
+	size_t numObjects = 0;
+
+	uint32_t take(uint32_t index, uint32_t generation, T* object) {
+		if (index >= slots.size())
+			slots.resize(std::max<size_t>(index + 1, slots.size() * 2));
+		slots[index].object = object;
+		slots[index].generation = generation;
+		numObjects++;
+		return makeId(index, generation);
+	}
+};
@@ -0,0 +1,66 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Allocates objects of the same type from big chunks instead of one by one on the heap.
+// Freed places are reused first (last freed, first reused), so objects created together
+// stay close in memory and mass creations/deletions don't fragment the heap.
+// Not thread-safe, each game state has its own pool.
+template <typename T, size_t CHUNK_SIZE = 256> class ObjectPool {
+public:
+	template <typename... Args> T* create(Args&&... args) {
+		if (!freeList)
+			addChunk();
+		Cell* cell = freeList;
+		freeList = cell->next;
+		T* obj = new (cell->storage) T(std::forward<Args>(args)...);
+		numLive++;
+		numPeak = std::max(numPeak, numLive);
+		return obj;
+	}
+
+	void destroy(T* obj) {
+		if (!obj)
+			return;
+		obj->~T();
+		Cell* cell = reinterpret_cast<Cell*>(obj);
+		cell->next = freeList;
+		freeList = cell;
+		numLive--;
+	}
+
+	size_t getLiveCount() const { return numLive; }
+	size_t getPeakCount() const { return numPeak; }
+	size_t getCapacity() const { return chunks.size() * CHUNK_SIZE; }
+
+	ObjectPool() = default;
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+private:
+	union Cell {
+		Cell* next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+	std::vector<std::unique_ptr<Cell[]>> chunks;
+	Cell* freeList = nullptr;
+	size_t numLive = 0, numPeak = 0;
+
+	void addChunk() {
+		Cell* chunk = chunks.emplace_back(new Cell[CHUNK_SIZE]).get();
+		// chained in address order, so that consecutive creations are contiguous
+		for (size_t i = CHUNK_SIZE; i-- > 0;) {
+			chunk[i].next = freeList;
+			freeList = &chunk[i];
+		}
+	}
+};
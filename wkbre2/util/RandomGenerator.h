@@ -0,0 +1,37 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+#pragma once
+
+#include <cstdint>
+
+// Small deterministic random number generator (PCG32), to be used instead of rand()
+// so that the simulation can be reproduced from its seed/state.
+struct RandomGenerator {
+	static constexpr uint64_t MULTIPLIER = 6364136223846793005ULL;
+	static constexpr uint64_t INCREMENT = 1442695040888963407ULL;
+
+	uint64_t state = 0x853C49E6748FEA9BULL;
+
+	void seed(uint64_t seedValue) {
+		state = 0;
+		next();
+		state += seedValue;
+		next();
+	}
+
+	uint32_t next() {
+		const uint64_t old = state;
+		state = old * MULTIPLIER + INCREMENT;
+		const uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+		const uint32_t rot = (uint32_t)(old >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+	// Integer in [0, bound[
+	uint32_t nextInt(uint32_t bound) { return bound ? (next() % bound) : 0; }
+
+	// Float in [0, 1[
+	float nextFloat() { return (float)(next() >> 8) / 16777216.0f; }
+};
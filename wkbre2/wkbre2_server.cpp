@@ -0,0 +1,168 @@
+// wkbre2 - WK Engine Reimplementation
+// (C) 2021 AdrienTD
+// Licensed under the GNU General Public License 3
+
+// wkbre2_server.cpp : entry point of the headless dedicated server.
+// Only the simulation is run here, no window, renderer, imgui or sound.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include "settings.h"
+#include "file.h"
+#include "server.h"
+#include "netenetlink.h"
+#include <nlohmann/json.hpp>
+#include <enet/enet.h>
+
+namespace {
+	struct DedicatedServer {
+		Server server;
+		ENetHost* eserver = nullptr;
+		std::vector<NetEnetLink*> guests;
+
+		bool init(uint16_t port) {
+			if (enet_initialize() != 0)
+				return false;
+			ENetAddress address;
+			address.host = ENET_HOST_ANY;
+			address.port = port;
+			eserver = enet_host_create(&address, 16, 2, 0, 0);
+			return eserver != nullptr;
+		}
+
+		void deinit() {
+			if (eserver)
+				enet_host_destroy(eserver);
+			eserver = nullptr;
+			enet_deinitialize();
+		}
+
+		void netHandle() {
+			ENetEvent event;
+			while (enet_host_service(eserver, &event, 0) > 0) {
+				switch (event.type) {
+				case ENET_EVENT_TYPE_CONNECT: {
+					printf("connection\n");
+					NetEnetLink* link = new NetEnetLink(eserver, event.peer);
+					event.peer->data = link;
+					guests.push_back(link);
+					server.addClient(link);
+					break;
+				}
+				case ENET_EVENT_TYPE_DISCONNECT: {
+					printf("disconnected\n");
+					NetEnetLink* link = (NetEnetLink*)event.peer->data;
+					guests.erase(std::find(guests.begin(), guests.end(), link));
+					server.removeClient(link);
+					delete link;
+					break;
+				}
+				case ENET_EVENT_TYPE_RECEIVE: {
+					NetEnetLink* link = (NetEnetLink*)event.peer->data;
+					link->packets.push(event.packet);
+					break;
+				}
+				}
+			}
+		}
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	printf("Welcome to wkbre2 dedicated server ! :)\n\n");
+
+	LoadSettings();
+	g_gamePath = std::filesystem::u8path(g_settings.value<std::string>("gamePath", "."));
+
+	if (!std::filesystem::exists(g_gamePath / "data.bcp")) {
+		printf("Could not find the file \"data.bcp\" in:\n%s\n", std::filesystem::absolute(g_gamePath).u8string().c_str());
+		return -5;
+	}
+
+	// Command line: wkbre2_server [savegame] [port]
+	// Otherwise taken from wkconfig.json.
+	std::string savfile = g_settings.value<std::string>("serverSaveGame", "");
+	if (argc >= 2)
+		savfile = argv[1];
+	uint16_t port = (uint16_t)g_settings.value<int>("serverPort", 1234);
+	if (argc >= 3)
+		port = (uint16_t)atoi(argv[2]);
+	const int numClients = g_settings.value<int>("serverNumClients", 1);
+	const int tickRate = std::max(1, g_settings.value<int>("serverTickRate", 60));
+	const uint64_t maxTicks = g_settings.value<uint64_t>("serverMaxTicks", 0);
+	const std::string traceFile = g_settings.value<std::string>("tickProfilerOutput", "");
+
+	if (savfile.empty()) {
+		printf("No savegame given. Usage: wkbre2_server <savegame> [port]\n");
+		return -1;
+	}
+	if (savfile.find('\\') == std::string::npos && savfile.find('/') == std::string::npos)
+		savfile = "Save_Games\\" + savfile;
+
+	LoadBCP("data.bcp");
+
+	DedicatedServer ds;
+	if (!ds.init(port)) {
+		printf("Could not create the ENet host on port %i\n", port);
+		return -2;
+	}
+
+	// Wait for the players before loading the level, so that they receive the whole game state
+	printf("Listening on port %i, waiting for %i client(s)...\n", port, numClients);
+	while ((int)ds.server.clientLinks.size() < numClients) {
+		ds.netHandle();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	printf("Loading %s\n", savfile.c_str());
+	ds.server.loadSaveGame(savfile.c_str());
+
+	// With a fixed step clock, one tick must be run for every step of game time
+	const TimeManager& timeManager = ds.server.timeManager;
+	const bool fastForward = timeManager.clockMode == TimeManager::ClockMode::FAST_FORWARD;
+	const int loopRate = timeManager.isFixedStep() ? (int)timeManager.tickRate : tickRate;
+	if (fastForward)
+		printf("Savegame loaded! Running as fast as possible.\n");
+	else
+		printf("Savegame loaded! Running at %i ticks per second.\n", loopRate);
+
+	// Fixed-rate loop: the next tick is scheduled from the previous deadline and not from
+	// the end of the previous tick, so slow ticks do not make the simulation drift.
+	using clock = std::chrono::steady_clock;
+	const auto tickPeriod = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / loopRate));
+	auto nextTick = clock::now();
+	for (uint64_t numTicks = 0; maxTicks == 0 || numTicks < maxTicks; numTicks++) {
+		ds.netHandle();
+		ds.server.tick();
+		enet_host_flush(ds.eserver);
+		if (fastForward)
+			continue;
+
+		nextTick += tickPeriod;
+		const auto now = clock::now();
+		if (nextTick > now)
+			std::this_thread::sleep_until(nextTick);
+		else if (now - nextTick > std::chrono::seconds(1))
+			nextTick = now; // too far behind, don't try to catch up
+	}
+
+#ifdef WKBRE2_TICK_PROFILER
+	// the events of the last tick are only committed at the start of the next one
+	TICKPROF_END_TICK(ds.server.tickProfiler);
+	if (!traceFile.empty()) {
+		if (ds.server.tickProfiler.dumpChromeTrace(traceFile.c_str()))
+			printf("Tick trace written to %s\n", traceFile.c_str());
+		else
+			printf("Could not write the tick trace to %s\n", traceFile.c_str());
+	}
+#endif
+
+	ds.deinit();
+	return 0;
+}